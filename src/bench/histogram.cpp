@@ -0,0 +1,68 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <algorithm>
+#include <cmath>
+
+#include <histogram.h>
+
+namespace whale {
+
+	/*
+	* bucket of @v: its magnitude above HIST_SUB_BITS bits selects a group
+	* of HIST_HALF_COUNT buckets, its top HIST_SUB_BITS bits one of them.
+	*/
+	size_t histogram::bucket_of(uint64_t v) {
+		int msb = v ? 63 - __builtin_clzll(v) : 0;
+		int m = std::max(0, msb - (HIST_SUB_BITS - 1));
+
+		return (size_t)m * HIST_HALF_COUNT + (v >> m);
+	}
+
+	/*
+	* Return: the largest value that falls into bucket @idx.
+	*/
+	uint64_t histogram::bucket_top(size_t idx) {
+		size_t m = idx < HIST_SUB_COUNT ? 0 : idx / HIST_HALF_COUNT - 1;
+		size_t sub = idx - m * HIST_HALF_COUNT;
+
+		return ((uint64_t)(sub + 1) << m) - 1;
+	}
+
+	void histogram::record(uint64_t v) {
+		++this->counts[bucket_of(v)];
+		++this->total;
+		this->sum += v;
+		this->min_val = std::min(this->min_val, v);
+		this->max_val = std::max(this->max_val, v);
+	}
+
+	void histogram::merge(const histogram & o) {
+		for (size_t i = 0; i < HIST_BUCKETS; ++i)
+			this->counts[i] += o.counts[i];
+
+		this->total += o.total;
+		this->sum += o.sum;
+		this->min_val = std::min(this->min_val, o.min_val);
+		this->max_val = std::max(this->max_val, o.max_val);
+	}
+
+	uint64_t histogram::percentile(double p) const {
+		uint64_t want = (uint64_t)std::ceil(p / 100.0 * this->total);
+		uint64_t seen = 0;
+
+		if (this->total == 0)
+			return 0;
+
+		want = std::max<uint64_t>(want, 1);
+
+		for (size_t i = 0; i < HIST_BUCKETS; ++i) {
+			seen += this->counts[i];
+
+			if (seen >= want)
+				return std::min(bucket_top(i), this->max_val);
+		}
+
+		return this->max_val;
+	}
+}
@@ -0,0 +1,57 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <vector>
+#include <cstdint>
+
+namespace whale {
+
+	/* 2^HIST_SUB_BITS buckets per power of two, relative error < 1% */
+	#define HIST_SUB_BITS   7
+	#define HIST_SUB_COUNT  (1 << HIST_SUB_BITS)
+	#define HIST_HALF_COUNT (1 << (HIST_SUB_BITS - 1))
+	#define HIST_BUCKETS    ((64 - HIST_SUB_BITS + 2) * HIST_HALF_COUNT)
+
+	/*
+	* HDR-style log-linear histogram of 64-bit values.
+	* Values below HIST_SUB_COUNT are recorded exactly, larger ones
+	* with HIST_SUB_BITS significant bits. Not thread-safe.
+	*/
+	class histogram {
+	public:
+		histogram()
+			:counts(HIST_BUCKETS, 0), total(0), sum(0),
+			 min_val(UINT64_MAX), max_val(0) {}
+
+		void record(uint64_t v);
+
+		/* add every value recorded in @o to this histogram */
+		void merge(const histogram & o);
+
+		/*
+		* Return: the smallest recorded value v such that @p percent
+		*         of the values are less or equal to v(within precision).
+		*/
+		uint64_t percentile(double p) const;
+
+		uint64_t count() const { return total; }
+		uint64_t min() const { return total ? min_val : 0; }
+		uint64_t max() const { return max_val; }
+		double   mean() const { return total ? (double)sum / total : 0; }
+	private:
+		static size_t   bucket_of(uint64_t v);
+		static uint64_t bucket_top(size_t idx);
+
+		std::vector<uint64_t> counts;
+		uint64_t              total;
+		uint64_t              sum;
+		uint64_t              min_val;
+		uint64_t              max_val;
+	};
+
+}
+#endif
@@ -0,0 +1,469 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include <log.h>
+#include <util.h>
+#include <whale_client.h>
+#include <histogram.h>
+
+namespace whale {
+
+	#define BENCH_CLUSTER_DIR   "whale_bench_cluster"
+	#define BENCH_BASE_PORT     31000
+	#define BENCH_SETTLE_TIME   2
+
+	typedef struct size_weight_s {
+		size_t   size;
+		w_uint_t weight;
+	} size_weight_t;
+
+	typedef struct bench_options_s {
+		std::string                nodes;
+		w_int_t                    local_nodes;
+		std::string                server_bin;
+		w_int_t                    base_port;
+		w_int_t                    connections;
+		w_int_t                    depth;
+		w_int_t                    rate;
+		w_int_t                    duration;
+		w_int_t                    warmup;
+		std::vector<size_weight_t> sizes;
+	} bench_options_t;
+
+	/* per-connection state, only touched on that client's io thread */
+	typedef struct bench_conn_s {
+		std::unique_ptr<whale_client> client;
+		histogram                     hist;
+		uint64_t                      ok;
+		uint64_t                      failed;
+		uint64_t                      redirects;
+		std::mt19937                  rng;
+	} bench_conn_t;
+
+	static std::atomic<bool> recording(false);
+	static std::atomic<bool> finished(false);
+	static std::vector<pid_t> cluster_pids;
+
+	static void usage(const char * prog) {
+		fprintf(stderr,
+		        "usage: %s [-n ip:port,...] [-l 3|5] [-b server] [-p base_port]\n"
+		        "          [-c connections] [-q depth] [-r ops/s] [-d seconds]\n"
+		        "          [-w seconds] [-s size:weight,...]\n"
+		        "  -n  serving addresses of the cluster\n"
+		        "  -l  launch a local cluster of 3 or 5 nodes instead of -n\n"
+		        "  -b  server binary for -l (default ./main)\n"
+		        "  -p  first port used by -l (default %d)\n"
+		        "  -c  client connections (default 1)\n"
+		        "  -q  outstanding requests per connection, closed loop (default 1)\n"
+		        "  -r  total request rate, open loop; 0 keeps the loop closed (default 0)\n"
+		        "  -d  measured duration in seconds (default 10)\n"
+		        "  -w  warmup in seconds, not measured (default 1)\n"
+		        "  -s  command size mix (default 64:1)\n",
+		        prog, BENCH_BASE_PORT);
+	}
+
+	/*
+	* parse "ip:port,ip:port" into @out.
+	* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+	*/
+	static w_rc_t parse_nodes(const std::string & s, std::vector<w_addr_t> & out) {
+		std::unique_ptr<char[]> b{new char[s.size() + 1]};
+		char                   *save_ptr;
+		char                   *p;
+
+		::strcpy(b.get(), s.c_str());
+
+		for (p = ::strtok_r(b.get(), ",", &save_ptr); p;
+		     p = ::strtok_r(NULL, ",", &save_ptr)) {
+			char     *port_p = ::strchr(p, ':');
+			w_addr_t  addr;
+
+			if (port_p == nullptr) {
+				log_error("missing port in node \"%s\"", p);
+				return WHALE_ERROR;
+			}
+
+			*port_p = '\0';
+			::memset(&addr.addr, 0, sizeof(struct sockaddr_in));
+			addr.addr.sin_family = AF_INET;
+			addr.addr.sin_port = ::htons(std::atoi(port_p + 1));
+
+			if (::inet_aton(p, &addr.addr.sin_addr) == 0) {
+				log_error("invalid node ip \"%s\"", p);
+				return WHALE_ERROR;
+			}
+
+			out.push_back(addr);
+		}
+
+		return out.empty() ? WHALE_ERROR : WHALE_GOOD;
+	}
+
+	/*
+	* parse "size:weight,size:weight" into @out.
+	* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+	*/
+	static w_rc_t parse_sizes(const std::string & s, std::vector<size_weight_t> & out) {
+		std::unique_ptr<char[]> b{new char[s.size() + 1]};
+		char                   *save_ptr;
+		char                   *p;
+
+		::strcpy(b.get(), s.c_str());
+
+		for (p = ::strtok_r(b.get(), ",", &save_ptr); p;
+		     p = ::strtok_r(NULL, ",", &save_ptr)) {
+			size_weight_t sw;
+			char         *weight_p = ::strchr(p, ':');
+
+			sw.size = std::atol(p);
+			sw.weight = weight_p ? std::atol(weight_p + 1) : 1;
+
+			if (sw.weight == 0)
+				continue;
+
+			out.push_back(sw);
+		}
+
+		return out.empty() ? WHALE_ERROR : WHALE_GOOD;
+	}
+
+	static std::string make_cmd(const std::vector<size_weight_t> & sizes,
+	                            std::mt19937 & rng) {
+		w_uint_t total = 0, pick;
+
+		for (const size_weight_t & sw : sizes)
+			total += sw.weight;
+
+		pick = rng() % total;
+
+		for (const size_weight_t & sw : sizes) {
+			if (pick < sw.weight)
+				return string_format("set k%u ", (unsigned)(rng() % 100000)) +
+				       std::string(sw.size, 'x');
+			pick -= sw.weight;
+		}
+
+		return std::string();
+	}
+
+	/*
+	* write whale.conf for every node of a local cluster and start them.
+	* nodes listen on loopback aliases 127.0.0.1 - 127.0.0.n so they can
+	* tell each other apart by ip.
+	* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+	*/
+	static w_rc_t launch_cluster(const bench_options_t & opts,
+	                             std::vector<w_addr_t> & nodes) {
+		char        server_path[PATH_MAX];
+		std::string nodes_s;
+
+		if (::realpath(opts.server_bin.c_str(), server_path) == nullptr) {
+			log_error("can't find server binary \"%s\": %s",
+			          opts.server_bin.c_str(), ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		::mkdir(BENCH_CLUSTER_DIR, 0755);
+
+		for (w_int_t i = 0; i < opts.local_nodes; ++i) {
+			std::string dir = string_format(BENCH_CLUSTER_DIR "/node%d", (int)i);
+			std::string peers;
+			FILE       *f;
+
+			for (w_int_t j = 0; j < opts.local_nodes; ++j) {
+				if (j == i) continue;
+				peers += string_format("%s127.0.0.%d:%d", peers.empty() ? "" : " ",
+				                       (int)j + 1, (int)(opts.base_port + 2 * j));
+			}
+
+			::mkdir(dir.c_str(), 0755);
+
+			/* every run starts from an empty log */
+			::unlink((dir + "/whale.log").c_str());
+			::unlink((dir + "/whale.map").c_str());
+
+			if ((f = ::fopen((dir + "/whale.conf").c_str(), "w")) == nullptr) {
+				log_error("failed to write %s/whale.conf: %s",
+				          dir.c_str(), ::strerror(errno));
+				return WHALE_ERROR;
+			}
+
+			fprintf(f, "log_file=whale.log\n"
+			           "listen_ip=127.0.0.%d\n"
+			           "listen_port=%d\n"
+			           "serving_port=%d\n"
+			           "peers=%s\n"
+			           "map_file=whale.map\n",
+			        (int)i + 1, (int)(opts.base_port + 2 * i),
+			        (int)(opts.base_port + 2 * i + 1), peers.c_str());
+			::fclose(f);
+
+			nodes_s += string_format("%s127.0.0.%d:%d", nodes_s.empty() ? "" : ",",
+			                         (int)i + 1, (int)(opts.base_port + 2 * i + 1));
+
+			pid_t pid = ::fork();
+
+			if (pid == -1) {
+				log_error("failed to ::fork: %s", ::strerror(errno));
+				return WHALE_ERROR;
+			}
+
+			if (pid == 0) {
+				int fd;
+
+				if (::chdir(dir.c_str()) == -1)
+					::_exit(1);
+
+				if ((fd = ::open("node.out", O_CREAT | O_TRUNC | O_WRONLY, 0644)) != -1) {
+					::dup2(fd, STDOUT_FILENO);
+					::dup2(fd, STDERR_FILENO);
+					::close(fd);
+				}
+
+				::execl(server_path, server_path, (char *)NULL);
+				::_exit(1);
+			}
+
+			cluster_pids.push_back(pid);
+		}
+
+		fprintf(stderr, "launched %d nodes in %s, waiting %ds for a leader\n",
+		        (int)opts.local_nodes, BENCH_CLUSTER_DIR, BENCH_SETTLE_TIME);
+		::sleep(BENCH_SETTLE_TIME);
+
+		return parse_nodes(nodes_s, nodes);
+	}
+
+	static void stop_cluster() {
+		for (pid_t pid : cluster_pids)
+			::kill(pid, SIGTERM);
+
+		for (pid_t pid : cluster_pids)
+			::waitpid(pid, nullptr, 0);
+
+		cluster_pids.clear();
+	}
+
+	static void account(bench_conn_t * c, const client_result_t & res,
+	                    uint64_t latency_us) {
+		if (!recording.load(std::memory_order_relaxed))
+			return;
+
+		if (res.ok) {
+			++c->ok;
+			c->hist.record(latency_us);
+		} else {
+			++c->failed;
+		}
+
+		c->redirects += res.redirects;
+	}
+
+	/*
+	* closed loop: every completion submits the next request.
+	*/
+	static void submit_closed(bench_conn_t * c, const bench_options_t & opts) {
+		c->client->submit(make_cmd(opts.sizes, c->rng),
+		                  [c, &opts](const client_result_t & res) {
+			if (finished.load(std::memory_order_relaxed))
+				return;
+
+			account(c, res, res.latency.count());
+			submit_closed(c, opts);
+		});
+	}
+
+	/*
+	* open loop: requests are issued on a fixed schedule regardless of
+	* completions. latency is taken from the scheduled start so stalls
+	* are not hidden by a backed-off sender.
+	*/
+	static void run_open_loop(std::vector<std::unique_ptr<bench_conn_t>> & conns,
+	                          const bench_options_t & opts,
+	                          w_clock::time_point end) {
+		std::chrono::nanoseconds interval(1000000000LL / opts.rate);
+		w_clock::time_point      next = w_clock::now();
+		std::mt19937             rng(::getpid());
+		size_t                   i = 0;
+
+		while (next < end) {
+			bench_conn_t        *c = conns[i++ % conns.size()].get();
+			w_clock::time_point  intended = next;
+
+			std::this_thread::sleep_until(next);
+			next += interval;
+
+			c->client->submit(make_cmd(opts.sizes, rng),
+			                  [c, intended](const client_result_t & res) {
+				if (finished.load(std::memory_order_relaxed))
+					return;
+
+				account(c, res, std::chrono::duration_cast<std::chrono::microseconds>(
+				                    w_clock::now() - intended).count());
+			});
+		}
+	}
+
+	static void report(std::vector<std::unique_ptr<bench_conn_t>> & conns,
+	                   const bench_options_t & opts) {
+		histogram hist;
+		uint64_t  ok = 0, failed = 0, redirects = 0;
+
+		for (auto & c : conns) {
+			hist.merge(c->hist);
+			ok += c->ok;
+			failed += c->failed;
+			redirects += c->redirects;
+		}
+
+		printf("connections  %d\n", (int)opts.connections);
+		if (opts.rate)
+			printf("mode         open loop, %d ops/s target\n", (int)opts.rate);
+		else
+			printf("mode         closed loop, depth %d\n", (int)opts.depth);
+		printf("duration     %ds\n", (int)opts.duration);
+		printf("completed    %llu\n", (unsigned long long)ok);
+		printf("failed       %llu\n", (unsigned long long)failed);
+		printf("redirects    %llu\n", (unsigned long long)redirects);
+		printf("throughput   %.1f ops/s\n", (double)ok / opts.duration);
+		printf("latency(us)  min %llu  mean %.1f  p50 %llu  p99 %llu  p99.9 %llu  max %llu\n",
+		       (unsigned long long)hist.min(), hist.mean(),
+		       (unsigned long long)hist.percentile(50),
+		       (unsigned long long)hist.percentile(99),
+		       (unsigned long long)hist.percentile(99.9),
+		       (unsigned long long)hist.max());
+	}
+
+	static int bench_main(int argc, char * const argv[]) {
+		bench_options_t       opts;
+		std::vector<w_addr_t> nodes;
+		std::string           sizes = "64:1";
+		int                   opt;
+
+		opts.local_nodes = 0;
+		opts.server_bin = "./main";
+		opts.base_port = BENCH_BASE_PORT;
+		opts.connections = 1;
+		opts.depth = 1;
+		opts.rate = 0;
+		opts.duration = 10;
+		opts.warmup = 1;
+
+		while ((opt = ::getopt(argc, argv, "n:l:b:p:c:q:r:d:w:s:h")) != -1) {
+			switch (opt) {
+			case 'n': opts.nodes = optarg; break;
+			case 'l': opts.local_nodes = std::atoi(optarg); break;
+			case 'b': opts.server_bin = optarg; break;
+			case 'p': opts.base_port = std::atoi(optarg); break;
+			case 'c': opts.connections = std::atoi(optarg); break;
+			case 'q': opts.depth = std::atoi(optarg); break;
+			case 'r': opts.rate = std::atoi(optarg); break;
+			case 'd': opts.duration = std::atoi(optarg); break;
+			case 'w': opts.warmup = std::atoi(optarg); break;
+			case 's': sizes = optarg; break;
+			default:
+				usage(argv[0]);
+				return 1;
+			}
+		}
+
+		if (parse_sizes(sizes, opts.sizes) != WHALE_GOOD) {
+			log_error("invalid size mix \"%s\"", sizes.c_str());
+			return 1;
+		}
+
+		if (opts.connections < 1 || opts.depth < 1 || opts.duration < 1 ||
+		    opts.rate < 0 || opts.warmup < 0) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if (opts.local_nodes) {
+			if (opts.local_nodes != 3 && opts.local_nodes != 5) {
+				log_error("a local cluster has 3 or 5 nodes");
+				return 1;
+			}
+
+			if (launch_cluster(opts, nodes) != WHALE_GOOD) {
+				stop_cluster();
+				return 1;
+			}
+		} else if (parse_nodes(opts.nodes, nodes) != WHALE_GOOD) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		client_options_t copts = INIT_CLIENT_OPTIONS;
+		copts.nodes = nodes;
+
+		std::vector<std::unique_ptr<bench_conn_t>> conns;
+
+		for (w_int_t i = 0; i < opts.connections; ++i) {
+			bench_conn_t * c = new bench_conn_t;
+
+			c->client.reset(new whale_client(copts));
+			c->ok = c->failed = c->redirects = 0;
+			c->rng.seed(::getpid() + i);
+			conns.push_back(std::unique_ptr<bench_conn_t>(c));
+
+			if (c->client->start() != WHALE_GOOD) {
+				log_error("failed to start client %d", (int)i);
+				stop_cluster();
+				return 1;
+			}
+		}
+
+		w_clock::time_point start = w_clock::now();
+		w_clock::time_point measure = start + std::chrono::seconds(opts.warmup);
+		w_clock::time_point end = measure + std::chrono::seconds(opts.duration);
+		std::thread         timer([measure, end]() {
+			std::this_thread::sleep_until(measure);
+			recording = true;
+			std::this_thread::sleep_until(end);
+			recording = false;
+		});
+
+		if (opts.rate) {
+			run_open_loop(conns, opts, end);
+		} else {
+			for (auto & c : conns)
+				for (w_int_t i = 0; i < opts.depth; ++i)
+					submit_closed(c.get(), opts);
+		}
+
+		timer.join();
+		finished = true;
+
+		/* joins the io threads, so every counter is visible below */
+		for (auto & c : conns)
+			c->client->stop();
+
+		report(conns, opts);
+		stop_cluster();
+
+		return 0;
+	}
+}
+
+int main(int argc, char * const argv[]) {
+	return whale::bench_main(argc, argv);
+}
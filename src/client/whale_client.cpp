@@ -0,0 +1,719 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+
+#include <log.h>
+
+#include <whale_client.h>
+
+namespace whale {
+
+	/*
+	* set @fd to nonblocking mode.
+	* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+	*/
+	static w_rc_t set_fd_nonblocking(el_socket_t fd) {
+		int flags = 0;
+
+		if ((flags = fcntl(fd, F_GETFL)) == -1) {
+			log_error("failed to fcntl(fd, F_GETFL) on fd[%d]: %s",
+			          fd, ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		if ((flags = fcntl(fd, F_SETFL, flags | O_NONBLOCK)) == -1){
+			log_error("failed to set nonblocking mode for fd[%d]: %s",
+			          fd, ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		return WHALE_GOOD;
+	}
+
+	/*
+	* gets called when the io thread is asked to pick up new requests.
+	*/
+	static void
+	wakeup_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_client * c = static_cast<whale_client *>(arg);
+		c->handle_wakeup();
+	}
+
+	/*
+	* gets called when requests parked for an unknown leader may be retried.
+	*/
+	static void
+	retry_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_client * c = static_cast<whale_client *>(arg);
+		c->handle_retry();
+	}
+
+	/*
+	* asynchronous connect syscall callback
+	*/
+	static void
+	conn_connect_callback(el_socket_t fd, short res_flags, void *arg) {
+		client_conn_t * c = static_cast<client_conn_t *>(arg);
+		c->client->handle_connected(c, fd);
+	}
+
+	/*
+	* handles reads and writes on a connection to a node.
+	*/
+	static void
+	conn_callback(el_socket_t fd, short res_flags, void *arg) {
+		client_conn_t * c = static_cast<client_conn_t *>(arg);
+		whale_client  * client = c->client;
+
+		if (res_flags & E_READ) {
+			client->handle_read(c);
+		}
+
+		if ((res_flags & E_WRITE) && c->connected) {
+			client->handle_write(c);
+		}
+	}
+
+	/*
+	* gets called after reconnect_timeout ms to reconnect to a node.
+	*/
+	static void
+	conn_reconnect_callback(el_socket_t fd, short res_flags, void *arg) {
+		client_conn_t * c = static_cast<client_conn_t *>(arg);
+
+		if (c->connected) return;
+
+		c->client->reconnect(c);
+	}
+
+	whale_client::~whale_client() {
+		stop();
+	}
+
+	inline void
+	whale_client::remove_event_if_in_reactor(struct event * e) {
+		if (event_in_reactor(e))
+			reactor_remove_event(&this->r, e);
+	}
+
+	w_rc_t whale_client::start() {
+		if (this->opts.nodes.empty()) {
+			log_error("no node to connect to.");
+			return WHALE_ERROR;
+		}
+
+		if (::pipe(this->wake_fds) == -1) {
+			log_error("failed to ::pipe: %s", ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		if (set_fd_nonblocking(this->wake_fds[0]) != WHALE_GOOD ||
+		    set_fd_nonblocking(this->wake_fds[1]) != WHALE_GOOD)
+			return WHALE_ERROR;
+
+		reactor_init_with_signal_timer(&this->r, NULL);
+
+		::memset(&this->wake_event, 0, sizeof(struct event));
+		::memset(&this->retry_event, 0, sizeof(struct event));
+
+		event_set(&this->wake_event, this->wake_fds[0], E_READ,
+		          wakeup_callback, this);
+
+		if (reactor_add_event(&this->r, &this->wake_event) == -1) {
+			log_error("failed to reactor_add_event for wake_event[%d]: %s",
+			          this->wake_fds[0], ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		for (const w_addr_t & addr : this->opts.nodes) {
+			client_conn_t * c = new client_conn_t;
+
+			c->addr = addr;
+			c->addr.addr.sin_family = AF_INET;
+			::memset(&c->e, 0, sizeof(struct event));
+			::memset(&c->timeout_e, 0, sizeof(struct event));
+			c->client = this;
+			c->connected = false;
+			c->want_write = false;
+			c->out_pin = 0;
+			c->in_len = 0;
+			c->in_pin = 0;
+
+			this->conns.push_back(std::unique_ptr<client_conn_t>(c));
+			reconnect(c);
+		}
+
+		this->started = true;
+		this->io_thread = std::thread([this]() {
+			struct timeval timeout = {0, 100000};
+
+			reactor_loop(&this->r, &timeout, 0);
+		});
+
+		return WHALE_GOOD;
+	}
+
+	void whale_client::stop() {
+		if (!this->started)
+			return;
+
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			this->stopping = true;
+		}
+
+		TEMP_FAILURE_RETRY(::write(this->wake_fds[1], "s", 1));
+
+		this->io_thread.join();
+		this->started = false;
+
+		reactor_destroy(&this->r);
+		TEMP_FAILURE_RETRY(::close(this->wake_fds[0]));
+		TEMP_FAILURE_RETRY(::close(this->wake_fds[1]));
+	}
+
+	void whale_client::enqueue(const std::string & cmd, client_callback cb,
+	                           bool read, w_int_t min_index) {
+		creq_uptr req{new client_request_t};
+
+		req->cmd = cmd;
+		req->cb = cb;
+		req->start = w_clock::now();
+		req->redirects = 0;
+		req->read = read;
+		req->min_index = min_index;
+
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			this->incoming.push_back(std::move(req));
+		}
+
+		/* a full pipe already guarantees a wakeup */
+		TEMP_FAILURE_RETRY(::write(this->wake_fds[1], "w", 1));
+	}
+
+	void whale_client::submit(const std::string & cmd, client_callback cb) {
+		enqueue(cmd, cb, false, CMD_LINEARIZABLE);
+	}
+
+	std::future<client_result_t> whale_client::submit(const std::string & cmd) {
+		std::shared_ptr<std::promise<client_result_t>> p =
+			std::make_shared<std::promise<client_result_t>>();
+		std::future<client_result_t> f = p->get_future();
+
+		submit(cmd, [p](const client_result_t & res) {
+			p->set_value(res);
+		});
+
+		return f;
+	}
+
+	void whale_client::read(const std::string & query, client_callback cb) {
+		enqueue(query, cb, true, CMD_LINEARIZABLE);
+	}
+
+	std::future<client_result_t> whale_client::read(const std::string & query) {
+		std::shared_ptr<std::promise<client_result_t>> p =
+			std::make_shared<std::promise<client_result_t>>();
+		std::future<client_result_t> f = p->get_future();
+
+		read(query, [p](const client_result_t & res) {
+			p->set_value(res);
+		});
+
+		return f;
+	}
+
+	void whale_client::read(const std::string & query, w_int_t min_index,
+	                        client_callback cb) {
+		enqueue(query, cb, true, min_index);
+	}
+
+	std::future<client_result_t> whale_client::read(const std::string & query,
+	                                                w_int_t min_index) {
+		std::shared_ptr<std::promise<client_result_t>> p =
+			std::make_shared<std::promise<client_result_t>>();
+		std::future<client_result_t> f = p->get_future();
+
+		read(query, min_index, [p](const client_result_t & res) {
+			p->set_value(res);
+		});
+
+		return f;
+	}
+
+	/*
+	* find the node whose ip matches @addr, nodes are identified by ip
+	* since redirect replies carry the leader's peer port.
+	* Return: index into @conns, -1 if unknown.
+	*/
+	w_int_t whale_client::find_node(const w_addr_t & addr) {
+		for (size_t i = 0; i < this->conns.size(); ++i) {
+			if (this->conns[i]->addr.addr.sin_addr.s_addr ==
+			    addr.addr.sin_addr.s_addr)
+				return i;
+		}
+
+		return -1;
+	}
+
+	/*
+	* pick the connection a request should go to: the cached leader if it
+	* is connected, otherwise any connected node, which redirects us.
+	* Return: the connection, nullptr if no node is connected.
+	*/
+	client_conn_t * whale_client::pick_conn() {
+		if (this->leader >= 0 && this->conns[this->leader]->connected)
+			return this->conns[this->leader].get();
+
+		return pick_any_conn();
+	}
+
+	/*
+	* pick any connected node, round robin, to spread session reads.
+	* Return: the connection, nullptr if no node is connected.
+	*/
+	client_conn_t * whale_client::pick_any_conn() {
+		for (size_t i = 0; i < this->conns.size(); ++i) {
+			client_conn_t * c = this->conns[this->next_node++ % this->conns.size()].get();
+
+			if (c->connected)
+				return c;
+		}
+
+		return nullptr;
+	}
+
+	void whale_client::dispatch(creq_uptr req) {
+		/*
+		* a session read tries any node first, once one turned it away
+		* for lagging behind it follows the redirects to the leader.
+		*/
+		client_conn_t * c = req->min_index != CMD_LINEARIZABLE &&
+		                    req->redirects == 0 ? pick_any_conn() : pick_conn();
+
+		if (c == nullptr) {
+			park(std::move(req));
+			return;
+		}
+
+		cmd_request_t cmd;
+		cmd.cmd = req->cmd;
+		cmd.read = req->read;
+		cmd.min_index = req->min_index;
+
+		c->out.push_back(msg_sptr{make_msg_from_cmd_request(cmd)});
+		c->inflight.push_back(std::move(req));
+	}
+
+	void whale_client::park(creq_uptr req) {
+		if (++req->redirects > this->opts.max_redirects) {
+			complete(std::move(req), nullptr, false);
+			return;
+		}
+
+		this->parked.push_back(std::move(req));
+
+		if (!event_in_reactor(&this->retry_event))
+			reset_retry_timer();
+	}
+
+	void whale_client::complete(creq_uptr req, client_conn_t * c, bool ok,
+	                            const std::string & value, w_int_t index) {
+		client_result_t res;
+
+		res.ok = ok;
+		res.value = value;
+		res.index = ok ? index : 0;
+
+		if (ok && index > this->session_index.load())
+			this->session_index.store(index);
+
+		if (c)
+			res.node = c->addr;
+		res.redirects = req->redirects;
+		res.latency = std::chrono::duration_cast<std::chrono::microseconds>(
+		                  w_clock::now() - req->start);
+
+		if (req->cb)
+			req->cb(res);
+	}
+
+	void whale_client::reset_retry_timer() {
+		remove_event_if_in_reactor(&this->retry_event);
+
+		event_set(&this->retry_event, this->opts.retry_timeout, E_TIMEOUT,
+		          retry_callback, this);
+
+		if (reactor_add_event(&this->r, &this->retry_event) == -1)
+			log_error("failed to reactor_add_event for"
+			          " retry timer event: %s", ::strerror(errno));
+	}
+
+	void whale_client::reset_reconnect_timer(client_conn_t * c) {
+		remove_event_if_in_reactor(&c->timeout_e);
+
+		event_set(&c->timeout_e, this->opts.reconnect_timeout, E_TIMEOUT,
+		          conn_reconnect_callback, c);
+
+		if (reactor_add_event(&this->r, &c->timeout_e) == -1)
+			log_error("failed to reactor_add_event for"
+			          " reconnecting timer event: %s", ::strerror(errno));
+	}
+
+	void whale_client::set_up_conn_events(client_conn_t * c, el_socket_t fd) {
+		short flags = E_READ | (c->want_write ? E_WRITE : 0);
+
+		remove_event_if_in_reactor(&c->e);
+
+		event_set(&c->e, fd, flags, conn_callback, c);
+
+		if (reactor_add_event(&this->r, &c->e) == -1)
+			log_error("failed to reactor_add_event for node fd[%d]: %s",
+			          fd, ::strerror(errno));
+	}
+
+	void whale_client::reconnect(client_conn_t * c) {
+		el_socket_t fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+		if (fd == -1) {
+			log_error("failed to ::socket: %s", ::strerror(errno));
+			reset_reconnect_timer(c);
+			return;
+		}
+
+		if (set_fd_nonblocking(fd) != WHALE_GOOD)
+			goto fail;
+
+		if (::connect(fd, (struct sockaddr*)&c->addr.addr,
+		              sizeof(struct sockaddr_in))) {
+			if (errno != EINPROGRESS) {
+				log_error("failed to ::connect to fd[%d]: %s",
+				          fd, ::strerror(errno));
+				goto fail;
+			}
+
+			remove_event_if_in_reactor(&c->e);
+			event_set(&c->e, fd, E_WRITE, conn_connect_callback, c);
+
+			if (reactor_add_event(&this->r, &c->e) == -1) {
+				log_error("failed to reactor_add_event connect event: %s",
+				          ::strerror(errno));
+				goto fail;
+			}
+
+			return;
+		}
+
+		handle_connected(c, fd);
+		return;
+
+	fail:
+		TEMP_FAILURE_RETRY(::close(fd));
+		reset_reconnect_timer(c);
+	}
+
+	void whale_client::handle_connected(client_conn_t * c, el_socket_t fd) {
+		int       err = 0;
+		socklen_t len = sizeof(err);
+
+		if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+			err = errno;
+
+		if (err) {
+			log_error("failed to connect to node fd[%d]: %s",
+			          fd, ::strerror(err));
+			remove_event_if_in_reactor(&c->e);
+			TEMP_FAILURE_RETRY(::close(fd));
+			reset_reconnect_timer(c);
+			return;
+		}
+
+		c->connected = true;
+		c->want_write = false;
+		set_up_conn_events(c, fd);
+
+		/* a node came up, requests waiting for one can go now */
+		if (!this->parked.empty())
+			handle_retry();
+	}
+
+	void whale_client::conn_cleanup(client_conn_t * c) {
+		std::deque<creq_uptr> inflight;
+
+		c->connected = false;
+		c->out.clear();
+		c->out_pin = 0;
+		c->in_len = c->in_pin = 0;
+		c->in_buf.reset();
+		inflight.swap(c->inflight);
+
+		remove_event_if_in_reactor(&c->e);
+		TEMP_FAILURE_RETRY(::close(c->e.fd));
+
+		if (this->leader >= 0 && this->conns[this->leader].get() == c)
+			this->leader = -1;
+
+		reset_reconnect_timer(c);
+
+		/* the node may or may not have seen them, resend */
+		while (!inflight.empty()) {
+			park(std::move(inflight.front()));
+			inflight.pop_front();
+		}
+	}
+
+	void whale_client::handle_wakeup() {
+		std::deque<creq_uptr> reqs;
+		char                  buf[256];
+		bool                  stop;
+
+		/* drain the pipe, one wakeup covers every pending request */
+		while (::read(this->wake_fds[0], buf, sizeof(buf)) > 0)
+			continue;
+
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			reqs.swap(this->incoming);
+			stop = this->stopping;
+		}
+
+		if (stop) {
+			for (auto & c : this->conns) {
+				for (auto & req : c->inflight)
+					complete(std::move(req), c.get(), false);
+				c->inflight.clear();
+				remove_event_if_in_reactor(&c->timeout_e);
+				if (c->connected) {
+					remove_event_if_in_reactor(&c->e);
+					TEMP_FAILURE_RETRY(::close(c->e.fd));
+					c->connected = false;
+				}
+			}
+
+			for (auto & req : this->parked)
+				complete(std::move(req), nullptr, false);
+			this->parked.clear();
+
+			for (auto & req : reqs)
+				complete(std::move(req), nullptr, false);
+
+			remove_event_if_in_reactor(&this->retry_event);
+			reactor_get_out(&this->r);
+			return;
+		}
+
+		while (!reqs.empty()) {
+			dispatch(std::move(reqs.front()));
+			reqs.pop_front();
+		}
+
+		/* flush the whole batch with one write per node */
+		for (auto & c : this->conns) {
+			if (c->connected && !c->out.empty())
+				handle_write(c.get());
+		}
+	}
+
+	void whale_client::handle_retry() {
+		std::deque<creq_uptr> reqs;
+
+		remove_event_if_in_reactor(&this->retry_event);
+		reqs.swap(this->parked);
+
+		/* requests that still find no node are parked again */
+		while (!reqs.empty()) {
+			dispatch(std::move(reqs.front()));
+			reqs.pop_front();
+		}
+
+		for (auto & c : this->conns) {
+			if (c->connected && !c->out.empty())
+				handle_write(c.get());
+		}
+	}
+
+	void whale_client::process_reply(client_conn_t * c, const message_t & m) {
+		cmdr_uptr cr{make_cmd_request_res_from_msg(m)};
+		creq_uptr req;
+		w_int_t   idx;
+
+		if (c->inflight.empty()) {
+			log_error("unsolicited reply from node fd[%d]", c->e.fd);
+			return;
+		}
+
+		req = std::move(c->inflight.front());
+		c->inflight.pop_front();
+
+		if (cr.get() == nullptr) {
+			log_error("malformed reply from node fd[%d]", c->e.fd);
+			complete(std::move(req), c, false);
+			return;
+		}
+
+		if (cr->res) {
+			complete(std::move(req), c, true, cr->value, cr->index);
+			return;
+		}
+
+		/* redirected, follow the hint if it names a node we know */
+		idx = find_node(cr->leader);
+
+		if (idx < 0 || this->conns[idx].get() == c) {
+			/* no leader known yet, wait for the election to settle */
+			this->leader = -1;
+			park(std::move(req));
+			return;
+		}
+
+		this->leader = idx;
+
+		if (++req->redirects > this->opts.max_redirects) {
+			complete(std::move(req), c, false);
+			return;
+		}
+
+		dispatch(std::move(req));
+	}
+
+	/*
+	* read as many replies as possible until ::read() returns EAGAIN.
+	*/
+	void whale_client::handle_read(client_conn_t * c) {
+		el_socket_t fd = c->e.fd;
+		w_int_t     nread;
+
+		while (true) {
+			if (c->in_buf.get() == nullptr) {
+				while (c->in_pin < sizeof(uint32_t)) {
+					nread = ::read(fd, (char *)&c->in_len + c->in_pin,
+					               sizeof(uint32_t) - c->in_pin);
+
+					if (nread <= 0) {
+						if (nread == -1 && errno == EINTR)
+							continue;
+						if (nread == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+							goto flush;
+
+						conn_cleanup(c);
+						return;
+					}
+					c->in_pin += nread;
+				}
+
+				if (::ntohl(c->in_len) < sizeof(message_t)) {
+					log_error("invalid frame length %u from node fd[%d]",
+					          ::ntohl(c->in_len), fd);
+					conn_cleanup(c);
+					return;
+				}
+
+				/* one extra byte keeps the json payload nul-terminated */
+				c->in_buf.reset(new char[::ntohl(c->in_len) + 1]);
+				::memcpy(c->in_buf.get(), &c->in_len, sizeof(uint32_t));
+				c->in_buf[::ntohl(c->in_len)] = '\0';
+			}
+
+			while (c->in_pin < ::ntohl(c->in_len)) {
+				nread = ::read(fd, c->in_buf.get() + c->in_pin,
+				               ::ntohl(c->in_len) - c->in_pin);
+
+				if (nread <= 0) {
+					if (nread == -1 && errno == EINTR)
+						continue;
+					if (nread == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+						goto flush;
+
+					conn_cleanup(c);
+					return;
+				}
+				c->in_pin += nread;
+			}
+
+			process_reply(c, *reinterpret_cast<message_t *>(c->in_buf.get()));
+
+			c->in_buf.reset();
+			c->in_pin = 0;
+		}
+
+	flush:
+		/* redirected requests may have been queued on other nodes */
+		for (auto & it : this->conns) {
+			if (it->connected && !it->out.empty())
+				handle_write(it.get());
+		}
+	}
+
+	/*
+	* write queued frames, coalescing up to max_batch of them per ::sendmsg().
+	*/
+	void whale_client::handle_write(client_conn_t * c) {
+		el_socket_t   fd = c->e.fd;
+		struct iovec  iov[WHALE_CLIENT_MAX_BATCH];
+		struct msghdr mh;
+		w_int_t       nwrite;
+
+		while (!c->out.empty()) {
+			size_t n = 0;
+			size_t max = std::min<size_t>(this->opts.max_batch, WHALE_CLIENT_MAX_BATCH);
+
+			for (auto it = c->out.begin(); it != c->out.end() && n < max; ++it, ++n) {
+				uint32_t pin = (n == 0 ? c->out_pin : 0);
+
+				iov[n].iov_base = reinterpret_cast<char *>(it->get()) + pin;
+				iov[n].iov_len = MESSAGE_SIZE(it->get()) - pin;
+			}
+
+			::memset(&mh, 0, sizeof(mh));
+			mh.msg_iov = iov;
+			mh.msg_iovlen = n;
+
+			/*
+			* our caller may not ignore SIGPIPE, a node that closed the
+			* connection shows up as EPIPE and we reconnect.
+			*/
+			nwrite = ::sendmsg(fd, &mh, MSG_NOSIGNAL);
+
+			if (nwrite == -1) {
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+
+				log_error("error occured during ::sendmsg() to fd[%d]: %s",
+				          fd, ::strerror(errno));
+				conn_cleanup(c);
+				return;
+			}
+
+			/* retire fully written frames */
+			while (nwrite > 0) {
+				uint32_t left = MESSAGE_SIZE(c->out.front().get()) - c->out_pin;
+
+				if ((uint32_t)nwrite < left) {
+					c->out_pin += nwrite;
+					break;
+				}
+
+				nwrite -= left;
+				c->out_pin = 0;
+				c->out.pop_front();
+			}
+		}
+
+		/* only ask for writability while something is left to write */
+		if (c->want_write != !c->out.empty()) {
+			c->want_write = !c->out.empty();
+			set_up_conn_events(c, fd);
+		}
+	}
+}
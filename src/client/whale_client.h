@@ -0,0 +1,225 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef WHALE_CLIENT_H_
+#define WHALE_CLIENT_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <functional>
+
+#include <sys/uio.h>
+
+#include <cheetah/reactor.h>
+
+#include <define.h>
+#include <message.h>
+
+namespace whale {
+
+	#define WHALE_CLIENT_MAX_REDIRECTS     8
+	#define WHALE_CLIENT_MAX_BATCH         64
+	#define WHALE_CLIENT_RECONNECT_TIMEOUT 1000
+	#define WHALE_CLIENT_RETRY_TIMEOUT     50
+
+	typedef std::chrono::steady_clock      w_clock;
+
+	/*
+	* outcome of one command, handed to the callback of the request.
+	*/
+	typedef struct client_result_s {
+		/* true if the command was committed by the cluster */
+		bool                      ok;
+		/* node that answered the request */
+		w_addr_t                  node;
+		/* times the request was redirected or resent */
+		w_uint_t                  redirects;
+		/* time from submission to completion */
+		std::chrono::microseconds latency;
+		/* reads only: the answer, empty if the key is not set */
+		std::string               value;
+		/*
+		* log index the write committed at, or the read was answered
+		* from. A token for session reads that must observe it.
+		*/
+		w_int_t                   index;
+	} client_result_t;
+
+	typedef std::function<void(const client_result_t &)> client_callback;
+
+	typedef struct client_options_s {
+		/* serving addresses of every node in the cluster */
+		std::vector<w_addr_t> nodes;
+		/* give up on a request after this many redirects */
+		w_uint_t              max_redirects;
+		/* at most this many frames are coalesced into one write */
+		w_uint_t              max_batch;
+		/* ms to wait before reconnecting to a node */
+		w_uint_t              reconnect_timeout;
+		/* ms to wait before retrying when no leader is known */
+		w_uint_t              retry_timeout;
+	} client_options_t;
+
+	#define INIT_CLIENT_OPTIONS    {                        \
+		.nodes = {},                                        \
+		.max_redirects = WHALE_CLIENT_MAX_REDIRECTS,        \
+		.max_batch = WHALE_CLIENT_MAX_BATCH,                \
+		.reconnect_timeout = WHALE_CLIENT_RECONNECT_TIMEOUT,\
+		.retry_timeout = WHALE_CLIENT_RETRY_TIMEOUT         \
+	}
+
+	class whale_client;
+
+	/* a command on its way to the cluster */
+	typedef struct client_request_s {
+		std::string        cmd;
+		client_callback    cb;
+		w_clock::time_point start;
+		w_uint_t           redirects;
+		/* a query, answered by the leader without going through the log */
+		bool               read;
+		/* session reads: the token, CMD_LINEARIZABLE otherwise */
+		w_int_t            min_index;
+	} client_request_t;
+
+	typedef std::unique_ptr<client_request_t> creq_uptr;
+
+	/* one pooled connection to a node */
+	typedef struct client_conn_s {
+		w_addr_t               addr;
+		struct event           e;
+		/* timeout event to reconnect to the node */
+		struct event           timeout_e;
+		whale_client          *client;
+		bool                   connected;
+		/* is E_WRITE currently registered for @e ? */
+		bool                   want_write;
+		/* frames waiting to be written, @out_pin bytes of the first are sent */
+		std::deque<msg_sptr>   out;
+		uint32_t               out_pin;
+		/* requests written out and waiting for replies, in sending order */
+		std::deque<creq_uptr>  inflight;
+		/* partially read reply */
+		uint32_t               in_len;
+		uint32_t               in_pin;
+		std::unique_ptr<char[]> in_buf;
+	} client_conn_t;
+
+	/*
+	* Non-blocking client of a whale cluster.
+	*
+	* Keeps one connection to every node, sends commands to the cached
+	* leader and follows redirect replies without surfacing them to the
+	* caller. Requests are pipelined on the leader connection and replies
+	* are matched in sending order. All network work happens on an
+	* internal thread; callbacks run on that thread too.
+	*
+	* Requests that were in flight on a broken connection are resent, so
+	* delivery is at-least-once.
+	*/
+	class whale_client {
+	public:
+		whale_client(const client_options_t & opts)
+			:opts(opts), leader(-1), next_node(0), session_index(0),
+			 wake_fds{-1, -1},
+			 stopping(false), started(false) {}
+		~whale_client();
+
+		/*
+		* connect to the nodes and start the io thread.
+		* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+		*/
+		w_rc_t start();
+
+		/*
+		* stop the io thread, pending requests are failed.
+		*/
+		void stop();
+
+		/*
+		* submit @cmd, @cb is called on the io thread once it completes.
+		* Safe to call from any thread.
+		*/
+		void submit(const std::string & cmd, client_callback cb);
+		std::future<client_result_t> submit(const std::string & cmd);
+
+		/*
+		* read with @query ("get <key>"), linearizable with the commands.
+		* The answer is in client_result_t::value. Safe to call from any thread.
+		*/
+		void read(const std::string & query, client_callback cb);
+		std::future<client_result_t> read(const std::string & query);
+
+		/*
+		* session read with @query, answered by any node that applied up
+		* to @min_index, followers included. Sees every write whose
+		* client_result_t::index is at most @min_index, but may miss
+		* newer ones. Safe to call from any thread.
+		*/
+		void read(const std::string & query, w_int_t min_index,
+		          client_callback cb);
+		std::future<client_result_t> read(const std::string & query,
+		                                  w_int_t min_index);
+
+		/*
+		* the highest index any request of this client completed with,
+		* read-your-writes for session reads passing it as min_index.
+		*/
+		w_int_t session_token() const { return session_index.load(); }
+
+		void handle_wakeup();
+		void handle_retry();
+		void handle_read(client_conn_t * c);
+		void handle_write(client_conn_t * c);
+		void handle_connected(client_conn_t * c, el_socket_t fd);
+		void reconnect(client_conn_t * c);
+	private:
+		void enqueue(const std::string & cmd, client_callback cb, bool read,
+		             w_int_t min_index);
+		void dispatch(creq_uptr req);
+		void park(creq_uptr req);
+		void complete(creq_uptr req, client_conn_t * c, bool ok,
+		              const std::string & value = "", w_int_t index = 0);
+		void process_reply(client_conn_t * c, const message_t & m);
+		void conn_cleanup(client_conn_t * c);
+		void set_up_conn_events(client_conn_t * c, el_socket_t fd);
+		void reset_reconnect_timer(client_conn_t * c);
+		void reset_retry_timer();
+		w_int_t find_node(const w_addr_t & addr);
+		client_conn_t * pick_conn();
+		client_conn_t * pick_any_conn();
+		void remove_event_if_in_reactor(struct event * e);
+
+		client_options_t                opts;
+		std::vector<std::unique_ptr<client_conn_t>> conns;
+		/* index into @conns of the cached leader, -1 if unknown */
+		w_int_t                         leader;
+		/* round robin cursor used while the leader is unknown */
+		w_uint_t                        next_node;
+		/* see session_token(), only the io thread raises it */
+		std::atomic<w_int_t>            session_index;
+		struct reactor                  r;
+		/* pipe used to wake the io thread up */
+		el_socket_t                     wake_fds[2];
+		struct event                    wake_event;
+		/* retry timer for requests parked while no leader is known */
+		struct event                    retry_event;
+		std::deque<creq_uptr>           parked;
+		/* requests submitted by callers, handed to the io thread */
+		std::mutex                      lock;
+		std::deque<creq_uptr>           incoming;
+		bool                            stopping;
+		bool                            started;
+		std::thread                     io_thread;
+	};
+
+}
+#endif
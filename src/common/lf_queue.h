@@ -0,0 +1,115 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef LF_QUEUE_H_
+#define LF_QUEUE_H_
+
+#include <atomic>
+#include <utility>
+
+namespace whale {
+
+	template <typename T>
+	struct lf_node {
+		std::atomic<lf_node *> next;
+		T                      val;
+
+		lf_node():next(nullptr) {}
+		lf_node(T && v):next(nullptr), val(std::move(v)) {}
+	};
+
+	/*
+	* Unbounded lock-free queue with one producer and one consumer thread.
+	* @head always points to a consumed node, the oldest value lives in
+	* @head->next.
+	*/
+	template <typename T>
+	class spsc_queue {
+	public:
+		spsc_queue():head(new lf_node<T>), tail(head) {}
+		~spsc_queue() {
+			T v;
+			while (pop(v))
+				continue;
+			delete head;
+		}
+
+		/* producer side */
+		void push(T && v) {
+			lf_node<T> * n = new lf_node<T>(std::move(v));
+
+			tail->next.store(n, std::memory_order_release);
+			tail = n;
+		}
+
+		/*
+		* consumer side.
+		* Return: false if the queue is empty.
+		*/
+		bool pop(T & v) {
+			lf_node<T> * n = head->next.load(std::memory_order_acquire);
+
+			if (n == nullptr)
+				return false;
+
+			v = std::move(n->val);
+			delete head;
+			head = n;
+			return true;
+		}
+	private:
+		/* consumer owned */
+		lf_node<T> * head;
+		/* producer owned */
+		lf_node<T> * tail;
+	};
+
+	/*
+	* Unbounded lock-free queue with many producer threads and one
+	* consumer thread. A push becomes visible to pop() only once the
+	* producer linked it in, so a producer should wake the consumer up
+	* after push() returned.
+	*/
+	template <typename T>
+	class mpsc_queue {
+	public:
+		mpsc_queue():head(new lf_node<T>), tail(head) {}
+		~mpsc_queue() {
+			T v;
+			while (pop(v))
+				continue;
+			delete head;
+		}
+
+		/* any thread */
+		void push(T && v) {
+			lf_node<T> * n = new lf_node<T>(std::move(v));
+			lf_node<T> * prev = tail.exchange(n, std::memory_order_acq_rel);
+
+			prev->next.store(n, std::memory_order_release);
+		}
+
+		/*
+		* consumer side.
+		* Return: false if the queue is empty.
+		*/
+		bool pop(T & v) {
+			lf_node<T> * n = head->next.load(std::memory_order_acquire);
+
+			if (n == nullptr)
+				return false;
+
+			v = std::move(n->val);
+			delete head;
+			head = n;
+			return true;
+		}
+	private:
+		/* consumer owned */
+		lf_node<T>               * head;
+		std::atomic<lf_node<T> *>  tail;
+	};
+
+}
+#endif
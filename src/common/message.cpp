@@ -17,30 +17,37 @@
 namespace whale {
 	
 	message_t * make_msg_from_cmd_request(const cmd_request_t & c) {
-		std::string  json(std::move(string_format("{\"cmd\":\"%s\"}",
-		                                          c.cmd.c_str())));
+		std::string  json(std::move(string_format("{\"cmd\":\"%s\","
+		                                          "\"min_index\":%ld}",
+		                                          json_escape(c.cmd).c_str(),
+		                                          c.read ? c.min_index :
+		                                          CMD_LINEARIZABLE)));
 
 		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
 
-		m->msg_type = ::htonl(MESSAGE_CMD_REQUEST);
+		m->msg_type = ::htonl(c.read ? MESSAGE_READ_REQUEST : MESSAGE_CMD_REQUEST);
 		m->len = ::htonl(sizeof(message_t) + json.size());
-		strcpy(m->data, json.c_str());
+		memcpy(m->data, json.data(), json.size());
 
 		return m;
 	}
 
 	message_t * make_msg_from_cmd_request_res(const cmd_request_res_t & cr) {
 		std::string  json(std::move(string_format("{%s,"
-						  "\"res\":%d}",
+						  "\"res\":%d,"
+						  "\"value\":\"%s\","
+						  "\"index\":%ld}",
 						  std::move(w_addr_to_json("leader", cr.leader)).c_str(),
-						  cr.res
+						  cr.res,
+						  json_escape(cr.value).c_str(),
+						  cr.index
 						  )));
 
 		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
 
-		m->msg_type = ::htonl(MESSAGE_CMD_REQUEST);
+		m->msg_type = ::htonl(MESSAGE_CMD_REQUEST_RES);
 		m->len = ::htonl(sizeof(message_t) + json.size());
-		strcpy(m->data, json.c_str());
+		memcpy(m->data, json.data(), json.size());
 
 		return m;
 	}
@@ -71,6 +78,12 @@ namespace whale {
 				return nullptr;
 
 		c->cmd.assign(p.get(), string_size);
+		c->index = c->term = c->lead_term = 0;
+		c->read = ::ntohl(m.msg_type) == MESSAGE_READ_REQUEST;
+
+		/* clients before session reads don't send it */
+		if (!c->read || xson_get_intptr_by_expr(root, "min_index", &c->min_index))
+			c->min_index = CMD_LINEARIZABLE;
 
 		return c.release();
 	}
@@ -82,6 +95,7 @@ namespace whale {
 		char                                ip_buf[50] = {0};
 		w_int_t                             port;
 		w_int_t                             res;
+		w_int_t                             string_size;
 
 		if (xson_init(&ctx, m.data))
 			return nullptr;
@@ -104,6 +118,22 @@ namespace whale {
 		cr->leader.addr.sin_port = ::htons(port);
 		cr->res = res;
 
+		/* servers before reads don't send it */
+		string_size = xson_get_stringsize_by_expr(root, "value");
+
+		if (string_size > 0) {
+			std::unique_ptr<char[]> p{new char[string_size]};
+
+			if (xson_get_string_by_expr(root, "value", p.get(), string_size))
+				return nullptr;
+
+			cr->value.assign(p.get(), string_size);
+		}
+
+		/* nor this one */
+		if (xson_get_intptr_by_expr(root, "index", &cr->index))
+			cr->index = 0;
+
 		return cr.release();
 	}
 }
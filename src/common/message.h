@@ -15,6 +15,16 @@ namespace whale {
 	#define MESSAGE_APPEND_ENTRIES_RES	3
 	#define MESSAGE_CMD_REQUEST         4
 	#define MESSAGE_CMD_REQUEST_RES     5
+	#define MESSAGE_FORWARD_CMD         6
+	#define MESSAGE_FORWARD_CMD_RES     7
+	#define MESSAGE_PRE_VOTE            8
+	#define MESSAGE_PRE_VOTE_RES        9
+	#define MESSAGE_TIMEOUT_NOW         10
+	/* a cmd_request_t that only reads, answered without a log entry */
+	#define MESSAGE_READ_REQUEST        11
+	/* a follower asking the leader for a read index on behalf of its clients */
+	#define MESSAGE_READ_INDEX          12
+	#define MESSAGE_READ_INDEX_RES      13
 
 	#define MESSAGE_PAYLOAD_LEN(m) ((m)->len - sizeof(int32_t))
 	#define MESSAGE_SIZE(m)        (::ntohl((m)->len))
@@ -34,9 +44,22 @@ namespace whale {
 
 	typedef struct cmd_request_s {
 		std::string cmd;
+		/* write: where it went in the log. read: the read index */
 		w_int_t     index;
+		/* write: the leader's term. read: the heartbeat round confirming it */
 		w_int_t     term;
+		/* a read served by us as leader: our term back then, 0 otherwise */
+		w_int_t     lead_term;
+		/* a query, sent as MESSAGE_READ_REQUEST */
+		bool        read;
+		/*
+		* session reads: any replica that applied up to this index
+		* answers, no leader involved. CMD_LINEARIZABLE otherwise.
+		*/
+		w_int_t     min_index;
 	} cmd_request_t;
+
+	#define CMD_LINEARIZABLE            -1
 	
 	typedef std::shared_ptr<cmd_request_t> cmd_sptr;
 	typedef std::unique_ptr<cmd_request_t> cmd_uptr;
@@ -45,6 +68,13 @@ namespace whale {
 	typedef struct cmd_reuqest_res_s {
 		w_addr_t    leader;
 		bool        res;
+		/* answer to a read, empty for writes */
+		std::string value;
+		/*
+		* writes: the log index committed at. reads: the applied index
+		* answered from. Good as min_index of later session reads.
+		*/
+		w_int_t     index;
 	} cmd_request_res_t;
 
 	typedef std::shared_ptr<cmd_request_res_t> cmdr_sptr;
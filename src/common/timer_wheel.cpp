@@ -0,0 +1,143 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <time.h>
+
+#include <timer_wheel.h>
+
+namespace whale {
+
+	uint64_t monotonic_ms() {
+		struct timespec ts;
+
+		::clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	}
+
+	static inline void list_init(w_timer_t * h) {
+		h->prev = h->next = h;
+	}
+
+	static inline void list_add_tail(w_timer_t * h, w_timer_t * t) {
+		t->prev = h->prev;
+		t->next = h;
+		h->prev->next = t;
+		h->prev = t;
+	}
+
+	static inline void list_del(w_timer_t * t) {
+		t->prev->next = t->next;
+		t->next->prev = t->prev;
+		t->prev = t->next = nullptr;
+	}
+
+	/* move every timer of @from to the empty list @to */
+	static inline void list_splice(w_timer_t * from, w_timer_t * to) {
+		if (from->next == from) {
+			list_init(to);
+			return;
+		}
+
+		to->next = from->next;
+		to->prev = from->prev;
+		to->next->prev = to;
+		to->prev->next = to;
+		list_init(from);
+	}
+
+	timer_wheel::timer_wheel() {
+		for (int l = 0; l < TW_LEVELS; ++l)
+			for (int i = 0; i < TW_SLOTS; ++i)
+				list_init(&this->slots[l][i]);
+
+		this->cur = monotonic_ms();
+		this->base = this->cur;
+	}
+
+	/*
+	* a timer goes to the finest level its distance from @base fits in,
+	* indexed by the bits of its expiry belonging to that level.
+	*/
+	void timer_wheel::place(w_timer_t * t) {
+		uint64_t expire = t->expire < this->base ? this->base : t->expire;
+		uint64_t delta = expire - this->base;
+		int      l;
+
+		if (delta > TW_MAX_DELAY) {
+			expire = this->base + TW_MAX_DELAY;
+			t->expire = expire;
+			delta = TW_MAX_DELAY;
+		}
+
+		for (l = 0; l < TW_LEVELS - 1; ++l) {
+			if (delta < (1ULL << (TW_BITS * (l + 1))))
+				break;
+		}
+
+		list_add_tail(&this->slots[l][(expire >> (TW_BITS * l)) & TW_MASK], t);
+	}
+
+	void timer_wheel::cascade(int level, unsigned idx) {
+		w_timer_t head;
+
+		list_splice(&this->slots[level][idx], &head);
+
+		while (head.next != &head) {
+			w_timer_t * t = head.next;
+
+			list_del(t);
+			place(t);
+		}
+	}
+
+	void timer_wheel::add(w_timer_t * t, uint64_t ms, timer_cb_t cb, void * arg) {
+		if (armed(t))
+			list_del(t);
+
+		t->expire = this->cur + ms;
+		t->cb = cb;
+		t->arg = arg;
+		place(t);
+	}
+
+	void timer_wheel::cancel(w_timer_t * t) {
+		if (armed(t))
+			list_del(t);
+	}
+
+	void timer_wheel::advance() {
+		w_timer_t due;
+		unsigned  idx;
+
+		this->cur = monotonic_ms();
+
+		while (this->base <= this->cur) {
+			idx = this->base & TW_MASK;
+
+			/* level 0 wrapped, pull the next block down from above */
+			if (idx == 0) {
+				for (int l = 1; l < TW_LEVELS; ++l) {
+					unsigned i = (this->base >> (TW_BITS * l)) & TW_MASK;
+
+					cascade(l, i);
+					if (i != 0)
+						break;
+				}
+			}
+
+			/*
+			* detach the slot before running it, timers armed by the
+			* callbacks for this very ms land on the next one.
+			*/
+			list_splice(&this->slots[0][idx], &due);
+			++this->base;
+
+			while (due.next != &due) {
+				w_timer_t * t = due.next;
+
+				list_del(t);
+				t->cb(t->arg);
+			}
+		}
+	}
+}
@@ -0,0 +1,77 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include <cstdint>
+
+#include <define.h>
+
+namespace whale {
+
+	/* 4 levels of 64 slots, 1ms per level 0 slot, reaching ~4.6 hours */
+	#define TW_BITS            6
+	#define TW_SLOTS           (1 << TW_BITS)
+	#define TW_MASK            (TW_SLOTS - 1)
+	#define TW_LEVELS          4
+	#define TW_MAX_DELAY       ((1ULL << (TW_BITS * TW_LEVELS)) - 1)
+
+	typedef void (*timer_cb_t)(void * arg);
+
+	/*
+	* a timer, embedded in whatever it times out. It is linked into one
+	* slot of the wheel while armed, so it must not move meanwhile.
+	*/
+	typedef struct w_timer_s {
+		struct w_timer_s *prev;
+		struct w_timer_s *next;
+		/* absolute expiry in ms of the wheel's clock */
+		uint64_t          expire;
+		timer_cb_t        cb;
+		void             *arg;
+	} w_timer_t;
+
+	#define INIT_TIMER   {nullptr, nullptr, 0, nullptr, nullptr}
+
+	/*
+	* Hierarchical timing wheel.
+	*
+	* Arming, rearming and cancelling are O(1) list operations. Timers
+	* far ahead sit in the coarser levels and are cascaded down as the
+	* wheel turns. advance() reads the monotonic clock once, caches it for
+	* now() and runs every timer that came due. Not thread safe.
+	*/
+	class timer_wheel {
+	public:
+		timer_wheel();
+
+		/* ms of the monotonic clock as of the last advance() */
+		uint64_t now() const { return cur; }
+
+		/*
+		* (re)arm @t to call @cb(@arg) @ms ms from now(). @t gets
+		* unlinked first if it is armed already.
+		*/
+		void add(w_timer_t * t, uint64_t ms, timer_cb_t cb, void * arg);
+		void cancel(w_timer_t * t);
+		static bool armed(const w_timer_t * t) { return t->next != nullptr; }
+
+		/* run every timer due by the monotonic clock */
+		void advance();
+	private:
+		void place(w_timer_t * t);
+		void cascade(int level, unsigned idx);
+
+		/* list heads, circular */
+		w_timer_t slots[TW_LEVELS][TW_SLOTS];
+		/* next ms to process, everything before it has fired */
+		uint64_t  base;
+		uint64_t  cur;
+	};
+
+	/* monotonic clock in ms */
+	uint64_t monotonic_ms();
+}
+#endif
@@ -41,4 +41,38 @@ namespace whale {
 											::inet_ntoa(addr.addr.sin_addr),
 											::ntohs(addr.addr.sin_port)));
 	}
+
+	std::string w_addr_to_string(const w_addr_t & addr) {
+		char ip[INET_ADDRSTRLEN];
+
+		if (::inet_ntop(AF_INET, &addr.addr.sin_addr, ip, sizeof(ip)) == nullptr)
+			return "";
+
+		return string_format("%s:%u", ip, ::ntohs(addr.addr.sin_port));
+	}
+
+	std::string json_escape(const std::string & s) {
+		std::string out;
+
+		out.reserve(s.size());
+
+		for (unsigned char ch : s) {
+			switch (ch) {
+			case '"':  out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\b': out += "\\b"; break;
+			case '\f': out += "\\f"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if (ch < 0x20)
+					out += string_format("\\u%04x", ch);
+				else
+					out += ch;
+			}
+		}
+
+		return out;
+	}
 }
\ No newline at end of file
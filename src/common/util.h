@@ -11,5 +11,15 @@
 namespace whale {
 	std::string string_format(const std::string fmt_str, ...);
 	std::string w_addr_to_json(const std::string & key_name, const w_addr_t & addr);
+	/*
+	* numeric "ip:port" form of @addr, used to name peers in logs.
+	* never touches the resolver, so it's safe on the reactor thread.
+	*/
+	std::string w_addr_to_string(const w_addr_t & addr);
+	/*
+	* @s escaped to go between the quotes of a json string: quotes,
+	* backslashes and control characters.
+	*/
+	std::string json_escape(const std::string & s);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,102 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <cstring>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <log.h>
+#include <whale_acceptor.h>
+
+namespace whale {
+
+	static void
+	acceptor_listen_callback(el_socket_t fd, short res_flags, void *arg) {
+		io_acceptor * a = static_cast<io_acceptor *>(arg);
+		a->handle_listen_fd();
+	}
+
+	static void
+	acceptor_wakeup_callback(el_socket_t fd, short res_flags, void *arg) {
+		io_acceptor * a = static_cast<io_acceptor *>(arg);
+		a->handle_wakeup();
+	}
+
+	io_acceptor::~io_acceptor() {
+		stop();
+	}
+
+	w_rc_t io_acceptor::start() {
+		if ((this->wake_fd = ::eventfd(0, EFD_NONBLOCK)) == -1) {
+			log_error("failed to create eventfd: %s", ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		reactor_init_with_signal_timer(&this->r, NULL);
+
+		::memset(&this->wake_event, 0, sizeof(struct event));
+		event_set(&this->wake_event, this->wake_fd, E_READ,
+		          acceptor_wakeup_callback, this);
+		::memset(&this->listen_event, 0, sizeof(struct event));
+		event_set(&this->listen_event, this->listen_fd, E_READ,
+		          acceptor_listen_callback, this);
+
+		if (reactor_add_event(&this->r, &this->wake_event) == -1 ||
+		    reactor_add_event(&this->r, &this->listen_event) == -1) {
+			log_error("failed to reactor_add_event for acceptor: %s",
+			          ::strerror(errno));
+			reactor_destroy(&this->r);
+			TEMP_FAILURE_RETRY(::close(this->wake_fd));
+			return WHALE_ERROR;
+		}
+
+		this->started = true;
+		this->thread = std::thread([this]() {
+			struct timeval timeout = {0, 100000};
+
+			reactor_loop(&this->r, &timeout, 0);
+		});
+
+		return WHALE_GOOD;
+	}
+
+	void io_acceptor::stop() {
+		uint64_t one = 1;
+
+		if (!this->started)
+			return;
+
+		this->stopping.store(true);
+		TEMP_FAILURE_RETRY(::write(this->wake_fd, &one, sizeof(one)));
+
+		this->thread.join();
+		this->started = false;
+
+		reactor_destroy(&this->r);
+		TEMP_FAILURE_RETRY(::close(this->wake_fd));
+		TEMP_FAILURE_RETRY(::close(this->listen_fd));
+	}
+
+	void io_acceptor::handle_wakeup() {
+		if (!this->stopping.load())
+			return;
+
+		reactor_remove_event(&this->r, &this->listen_event);
+		reactor_remove_event(&this->r, &this->wake_event);
+		reactor_get_out(&this->r);
+	}
+
+	void io_acceptor::handle_listen_fd() {
+		w_uint_t cnt;
+
+		cnt = accept_all(this->listen_fd, [this](el_socket_t fd,
+		                                         const w_addr_t & addr) {
+			this->accepted->push({fd, addr});
+		});
+
+		if (cnt)
+			wake_up(this->core_wake);
+	}
+}
@@ -0,0 +1,96 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef WHALE_ACCEPTOR_H_
+#define WHALE_ACCEPTOR_H_
+
+#include <atomic>
+#include <thread>
+#include <cstring>
+
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <cheetah/reactor.h>
+
+#include <define.h>
+#include <log.h>
+#include <lf_queue.h>
+#include <whale_worker.h>
+
+namespace whale {
+
+	/* a client connection accepted off the reactor thread */
+	typedef struct accepted_conn_s {
+		el_socket_t fd;
+		w_addr_t    addr;
+	} accepted_conn_t;
+
+	/*
+	* A thread accepting client connections on its own SO_REUSEPORT
+	* listening socket. Every readiness event is drained with accept4()
+	* until EAGAIN, the new sockets are handed to the core through
+	* @accepted with one wakeup per batch.
+	*/
+	class io_acceptor {
+	public:
+		io_acceptor(el_socket_t listen_fd, mpsc_queue<accepted_conn_t> * accepted,
+		            wake_t * core_wake)
+			:listen_fd(listen_fd), accepted(accepted), core_wake(core_wake),
+			 stopping(false), started(false) {}
+		~io_acceptor();
+
+		/*
+		* start the acceptor thread.
+		* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+		*/
+		w_rc_t start();
+		void stop();
+
+		void handle_listen_fd();
+		void handle_wakeup();
+	private:
+		el_socket_t                     listen_fd;
+		struct reactor                  r;
+		struct event                    listen_event;
+		/* only used to stop the thread */
+		el_socket_t                     wake_fd;
+		struct event                    wake_event;
+		mpsc_queue<accepted_conn_t>    *accepted;
+		wake_t                         *core_wake;
+		std::atomic<bool>               stopping;
+		bool                            started;
+		std::thread                     thread;
+	};
+
+	/*
+	* accept every pending connection on nonblocking @listen_fd and call
+	* @fn(fd, addr) for each.
+	* Return: number of connections accepted.
+	*/
+	template <typename F>
+	w_uint_t accept_all(el_socket_t listen_fd, F fn) {
+		w_uint_t cnt = 0;
+
+		for (;;) {
+			w_addr_t    addr;
+			socklen_t   sock_len = sizeof(struct sockaddr_in);
+			el_socket_t fd = ::accept4(listen_fd, (struct sockaddr*)&addr.addr,
+			                           &sock_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+			if (fd == -1) {
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+					log_error("failed to ::accept4 client connection: %s",
+					          ::strerror(errno));
+				return cnt;
+			}
+
+			fn(fd, addr);
+			++cnt;
+		}
+	}
+}
+#endif
@@ -16,11 +16,7 @@
 namespace whale {
 
 	void config::getline(w_int_t fd, std::string & linebuf){
-		static int 		payload = 0;
-		static char 	buf[CONF_BUFSIZE];
-		static char	   *start = buf;
-		static char    *end = buf;
-		static bool		eof = false;
+		char       *end;
 		int			nread = 0;
 
 	again:
@@ -51,11 +47,10 @@ namespace whale {
 		}
 
 		/* reached eof, treat it as the last line*/
-		if (payload != CONF_BUFSIZE) {
+		if (payload != CONF_BUFSIZE)
 			eof = true;
-			/* strchr might reach a stale '\n' after buf + payload, clean it up*/
-			buf[payload] = '\0';
-		}
+		/* strchr might reach a stale '\n' after buf + payload, clean it up*/
+		buf[payload] = '\0';
 
 		start = end = buf;
 
@@ -72,6 +67,13 @@ namespace whale {
 			return WHALE_ERROR;
 		}
 
+		/* the file may be parsed again, by a new config on SIGHUP */
+		payload = 0;
+		buf[0] = '\0';
+		start = buf;
+		eof = false;
+		conf_map.clear();
+
 		while (true){
 			std::string line;
 
@@ -93,6 +95,7 @@ namespace whale {
 			if (p != NULL) {
 				log_error("syntax error at line %d: at most one \'=\' could appear on each line.",
 						 lineno);
+				::close(fd);
 				return WHALE_CONF_ERROR;
 			}
 
@@ -101,6 +104,7 @@ namespace whale {
 			++lineno;
 		}
 
+		::close(fd);
 		return WHALE_GOOD;
 	}
 }
\ No newline at end of file
@@ -36,6 +36,11 @@ namespace whale {
 		void getline(w_int_t fd, std::string & linebuf);
 		std::string 						cfg_file;
 		std::map<std::string, std::string>  conf_map;
+		/* read buffer of getline(), bytes in [@start, @buf + @payload) are unread */
+		char                                buf[CONF_BUFSIZE + 1];
+		int                                 payload;
+		char                               *start;
+		bool                                eof;
 	};
 
 }
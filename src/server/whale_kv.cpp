@@ -0,0 +1,51 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <sstream>
+#include <cstdlib>
+
+#include <whale_kv.h>
+
+namespace whale {
+
+	void kv_store::apply(const std::string & cmd) {
+		/* what the json parser handed us may carry its nul */
+		std::istringstream in(std::string(cmd.c_str()));
+		std::string        op, key, value;
+
+		if (!(in >> op >> key))
+			return;
+
+		if (op == "set") {
+			std::getline(in >> std::ws, value);
+			this->data[key] = value;
+		} else if (op == "del") {
+			this->data.erase(key);
+		} else if (op == "add") {
+			long long n = 0;
+
+			if (!(in >> n))
+				return;
+
+			auto it = this->data.find(key);
+
+			if (it != this->data.end())
+				n += std::strtoll(it->second.c_str(), nullptr, 10);
+
+			this->data[key] = std::to_string(n);
+		}
+	}
+
+	bool kv_store::query(const std::string & q, std::string & value) {
+		std::istringstream in(std::string(q.c_str()));
+		std::string        op, key;
+
+		if (!(in >> op >> key) || op != "get")
+			return false;
+
+		auto it = this->data.find(key);
+
+		value = it == this->data.end() ? "" : it->second;
+		return true;
+	}
+}
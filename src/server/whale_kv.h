@@ -0,0 +1,44 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef WHALE_KV_H_
+#define WHALE_KV_H_
+
+#include <string>
+#include <unordered_map>
+
+#include <define.h>
+
+namespace whale {
+
+	/*
+	* The state machine committed entries are applied to, a string map.
+	*
+	* Commands are space separated words:
+	*     set <key> <value>
+	*     del <key>
+	*     add <key> <n>     adds the integer n to the value, 0 if unset
+	* Anything else is applied as a no-op. Queries:
+	*     get <key>
+	*/
+	class kv_store {
+	public:
+		/* apply a committed command */
+		void apply(const std::string & cmd);
+
+		/*
+		* answer query @q into @value.
+		* Return: false if @q isn't a query we know.
+		*/
+		bool query(const std::string & q, std::string & value);
+
+		size_t size() {
+			return data.size();
+		}
+	private:
+		std::unordered_map<std::string, std::string> data;
+	};
+
+}
+#endif
@@ -10,6 +10,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include <log.h>
 #include <whale_log.h>
@@ -26,7 +27,7 @@ namespace whale {
 
 		std::unique_ptr<char[]> p;
 		size_t                  bufsize = 0;
-		size_t                  len;
+		uint32_t                len;
 		size_t                  n;
 		w_int_t                 nread;
 
@@ -56,6 +57,7 @@ namespace whale {
 				bufsize = len;
 			}
 
+			n = 0;
 			while(n < len) {
 				nread = ::read(fd, p.get() + n, len - n);
 				
@@ -79,11 +81,12 @@ namespace whale {
 			entries.back().index = *(int32_t*)p.get();
 			entries.back().term = *((int32_t*)p.get() + 1);
 			entries.back().data.append(p.get() + 2 * sizeof(int32_t), 
-				                        bufsize - 2 * sizeof(int32_t));
+				                        len - 2 * sizeof(int32_t));
 		}
 		
 		this->pos = ::lseek(fd, 0, SEEK_CUR);
 		this->commit_idx = this->entries.end() - this->entries.begin();
+		this->durable_idx = this->entries.back().index;
 		return WHALE_GOOD;
 	}
 
@@ -124,38 +127,211 @@ namespace whale {
 		}
 	}
 	
+	void logger::serialize(w_int_t from, w_int_t to, char * buf) {
+		for (w_int_t i = from; i < to; ++i) {
+			log_entry_t & e = this->entries[i];
+			uint32_t      len = LOG_ENTRY_LEN(e);
+
+			::memcpy(buf, &len, sizeof(uint32_t));
+			::memcpy(buf + sizeof(uint32_t), &e.index, sizeof(int32_t));
+			::memcpy(buf + sizeof(uint32_t) + sizeof(int32_t),
+			         &e.term, sizeof(int32_t));
+			::memcpy(buf + sizeof(uint32_t) + 2 * sizeof(int32_t),
+			         e.data.c_str(), e.data.size());
+
+			buf += LOG_RECORD_LEN(e);
+		}
+	}
+
 	/*
-	* commit all entries whose index is less or equal to @end
+	* commit all entries whose index is less or equal to @end.
+	* the records go out in one write followed by one fdatasync.
 	*/
 	void logger::commit_until(w_int_t end) {
-		std::unique_ptr<char[]> p;
-		size_t                  bufsize = 0;
+		w_int_t from = this->commit_idx;
+		w_int_t to = from;
+		size_t  len = 0;
+
+		while (this->entries.begin() + to < this->entries.end() &&
+		       this->entries[to].index <= end) {
+			len += LOG_RECORD_LEN(this->entries[to]);
+			++to;
+		}
+
+		if (to == from)
+			return;
+
+		this->commit_idx = to;
+
+#ifdef WHALE_HAVE_IO_URING
+		if (this->ring) {
+			submit_batch(from, to, len);
+			return;
+		}
+#endif
+		std::unique_ptr<char[]> p(new char[len]);
+
+		serialize(from, to, p.get());
+		this->write(p.get(), len);
+
+		::fdatasync(this->fd);
+		this->pos = ::lseek(this->fd, 0, SEEK_CUR);
+		this->durable_idx = this->entries[to - 1].index;
+	}
+
+#ifdef WHALE_HAVE_IO_URING
+	w_rc_t logger::use_uring(uring * ring) {
+		struct iovec iov[WHALE_LOG_SLOTS];
+
+		this->slots.reset(new char[WHALE_LOG_SLOTS * WHALE_LOG_SLOT_SIZE]);
+
+		for (w_int_t i = 0; i < WHALE_LOG_SLOTS; ++i) {
+			iov[i].iov_base = this->slots.get() + i * WHALE_LOG_SLOT_SIZE;
+			iov[i].iov_len = WHALE_LOG_SLOT_SIZE;
+		}
+
+		/* batches still go through the ring, just not from registered memory */
+		if (ring->register_buffers(iov, WHALE_LOG_SLOTS) == -1) {
+			log_error("failed to register log buffers: %s", ::strerror(errno));
+			this->slots.reset();
+		}
+
+		this->ring = ring;
+		return WHALE_GOOD;
+	}
+
+	/*
+	* queue a write of the records of entries in [@from, @to) at the end of
+	* the file, linked with a fdatasync, and submit both.
+	*/
+	void logger::submit_batch(w_int_t from, w_int_t to, size_t len) {
+		struct io_uring_sqe * w;
+		struct io_uring_sqe * sync;
+		char                * buf;
+
+		this->inflight.push_back({++this->batch_seq,
+		                          this->entries[to - 1].index,
+		                          this->pos, len, -1, nullptr, false});
+		log_batch_t & b = this->inflight.back();
+
+		for (w_int_t i = 0; this->slots.get() && len <= WHALE_LOG_SLOT_SIZE &&
+		                    i < WHALE_LOG_SLOTS; ++i) {
+			if (!this->slot_busy[i]) {
+				this->slot_busy[i] = true;
+				b.slot = i;
+				break;
+			}
+		}
+
+		if (b.slot == -1) {
+			b.heap.reset(new char[len]);
+			buf = b.heap.get();
+		} else {
+			buf = this->slots.get() + b.slot * WHALE_LOG_SLOT_SIZE;
+		}
+
+		serialize(from, to, buf);
+		this->pos += len;
+
+		if ((w = this->ring->get_sqe()) == nullptr) {
+			this->ring->submit();
+			w = this->ring->get_sqe();
+		}
+
+		if (w == nullptr || (sync = this->ring->get_sqe()) == nullptr) {
+			/* ring is full, it's done the old way then */
+			log_error("io_uring submission queue full, writing log inline");
+			if (w)
+				w->opcode = IORING_OP_NOP;
+			finish_batch(b);
+			retire_batches();
+			return;
+		}
+
+		w->opcode = b.slot == -1 ? IORING_OP_WRITE : IORING_OP_WRITE_FIXED;
+		w->fd = this->fd;
+		w->addr = (uint64_t)(uintptr_t)buf;
+		w->len = len;
+		w->off = b.off;
+		w->buf_index = b.slot == -1 ? 0 : b.slot;
+		w->flags = IOSQE_IO_LINK;
+		w->user_data = URING_DATA(URING_OP_LOG, (b.seq << 1) | 1);
+
+		sync->opcode = IORING_OP_FSYNC;
+		sync->fd = this->fd;
+		sync->fsync_flags = IORING_FSYNC_DATASYNC;
+		sync->user_data = URING_DATA(URING_OP_LOG, b.seq << 1);
+
+		if (this->ring->submit() == -1)
+			log_error("failed to submit log write: %s", ::strerror(errno));
+	}
+
+	/*
+	* write and sync @b inline, for when the ring can't take it or its
+	* asynchronous write fell short.
+	*/
+	void logger::finish_batch(log_batch_t & b) {
+		char  * buf = b.slot == -1 ? b.heap.get() :
+		              this->slots.get() + b.slot * WHALE_LOG_SLOT_SIZE;
+		size_t  n = 0;
+		ssize_t nwrite;
 
-		for (;this->commit_idx < end && 
-			  this->entries.begin() + this->commit_idx < this->entries.end();
-			  ++this->commit_idx) {
-			log_entry_t & e = this->entries[this->commit_idx];
-			
-			if (LOG_ENTRY_LEN(e) > bufsize) {
-				bufsize = LOG_ENTRY_LEN(e);
-				p.reset(new char[bufsize]);
+		while (n < b.len) {
+			nwrite = ::pwrite(this->fd, buf + n, b.len - n, b.off + n);
+
+			if (nwrite == -1 && errno == EINTR)
+				continue;
+
+			if (nwrite <= 0) {
+				log_error("failed to write log file: %s", strerror(errno));
+				::abort();
 			}
+			n += nwrite;
+		}
 
-			*(uint32_t*)p.get() = LOG_ENTRY_LEN(e);
-			*((int32_t *)((uint32_t*)p.get() + 1)) = e.index;
-			*((int32_t *)((uint32_t*)p.get() + 1) + 1) = e.term;
-			memcpy(((int32_t *)((uint32_t*)p.get() + 1) + 1),
-				  e.data.c_str(),
-				  e.data.size());
+		::fdatasync(this->fd);
+		b.done = true;
+	}
 
-			this->write(p.get(), LOG_ENTRY_LEN(e));
+	void logger::complete(uint64_t value, int32_t res) {
+		w_uint_t seq = value >> 1;
+		bool     write = value & 1;
+
+		for (log_batch_t & b : this->inflight) {
+			if (b.seq != seq || b.done)
+				continue;
+
+			if (write) {
+				/* a short write cancels the linked sync, redo it inline */
+				if (res < 0 || (size_t)res != b.len)
+					finish_batch(b);
+			} else if (res == 0) {
+				b.done = true;
+			} else if (res != -ECANCELED) {
+				log_error("failed to fdatasync log file: %s", strerror(-res));
+				::abort();
+			}
+			break;
 		}
 
-		if (p.get()) {
-			::fdatasync(this->fd);
-			this->pos = ::lseek(this->fd, 0, SEEK_CUR);
+		retire_batches();
+	}
+
+	/*
+	* batches become durable in order, a sync finishing early doesn't
+	* cover an earlier write still in flight.
+	*/
+	void logger::retire_batches() {
+		while (!this->inflight.empty() && this->inflight.front().done) {
+			log_batch_t & b = this->inflight.front();
+
+			if (b.slot != -1)
+				this->slot_busy[b.slot] = false;
+			this->durable_idx = b.last_index;
+			this->inflight.pop_front();
 		}
 	}
+#endif
 
 	/*
 	* erase entries starting at @start and those follow it.
@@ -168,9 +344,9 @@ namespace whale {
 			log_entry_it it;
 			for(it = start; 
 				it != this->entries.end() &&
-				it - this->entries.begin() <= commit_idx;
+				it - this->entries.begin() < commit_idx;
 				++it) {
-				dec += LOG_ENTRY_LEN(*it);
+				dec += LOG_RECORD_LEN(*it);
 			}
 
 			this->commit_idx = idx;
@@ -187,7 +363,7 @@ namespace whale {
 	* append entries in @new_entries.
 	*/
 	void logger::append(std::vector<log_entry_t> new_entries) {
-		this->entries.insert(this->entries.begin(), 
+		this->entries.insert(this->entries.end(), 
 			                 new_entries.begin(), new_entries.end());
 	}
 }
\ No newline at end of file
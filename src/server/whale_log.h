@@ -7,8 +7,11 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <memory>
 
 #include <define.h>
+#include <whale_uring.h>
 
 namespace whale {
 
@@ -25,12 +28,45 @@ namespace whale {
 	typedef std::vector<log_entry_t>::iterator log_entry_it;
 	#define LOG_ENTRY_SENTINEL log_entry_t{0, 0, ""}
 
+	/*
+	* entries whose data starts with this carry the cluster members,
+	* space separated ip:port, instead of a client command.
+	*/
+	#define LOG_CONF_PREFIX     "@members "
+	#define LOG_DATA_IS_CONF(d) \
+		((d).compare(0, sizeof(LOG_CONF_PREFIX) - 1, LOG_CONF_PREFIX) == 0)
+	/* appended by a new leader to commit everything before its term */
+	#define LOG_NOOP_DATA       "@noop"
+	/* entries of our own, not applied to the state machine */
+	#define LOG_DATA_INTERNAL(d) (!(d).empty() && (d)[0] == '@')
+
 	#define LOG_ENTRY_LEN(e) ((e).data.size() + 2 * sizeof(int32_t))
+	/* on-disk size of an entry: its length followed by the entry */
+	#define LOG_RECORD_LEN(e) (LOG_ENTRY_LEN(e) + sizeof(uint32_t))
+
+	/* registered buffers for batched log writes through io_uring */
+	#define WHALE_LOG_SLOTS         4
+	#define WHALE_LOG_SLOT_SIZE     (256 * 1024)
+
+	/* records handed to the kernel in one write followed by a sync */
+	typedef struct log_batch_s {
+		w_uint_t                seq;
+		/* index of the last entry in the batch */
+		w_int_t                 last_index;
+		off_t                   off;
+		size_t                  len;
+		/* registered buffer holding the records, -1 if @heap does */
+		w_int_t                 slot;
+		std::unique_ptr<char[]> heap;
+		/* written and synced */
+		bool                    done;
+	} log_batch_t;
+
 	class logger {
 	public:
 
 		logger(std::string log_filename):log_file(log_filename),
-			  fd(-1), entries({LOG_ENTRY_SENTINEL}) {}
+			  fd(-1), durable_idx(0), entries({LOG_ENTRY_SENTINEL}) {}
 
 		/*
 		* Bring the log entries in log file into memory.
@@ -66,13 +102,53 @@ namespace whale {
 		*         an iterator pointing to the end of @entries(i.e. "entries.end()").
 		*/
 		log_entry_it find_by_idx(int32_t idx);
+
+		/* index of the last entry known to be on disk */
+		w_int_t durable_index() {
+			return durable_idx;
+		}
+
+		/* are writes in flight while commit_until() returns ? */
+		bool async() {
+#ifdef WHALE_HAVE_IO_URING
+			return ring != nullptr;
+#else
+			return false;
+#endif
+		}
+#ifdef WHALE_HAVE_IO_URING
+		/*
+		* hand writes to @ring as a write linked with a fdatasync instead
+		* of doing them inline.
+		* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+		*/
+		w_rc_t use_uring(uring * ring);
+
+		/*
+		* handles the completion of a log write or sync issued to the ring.
+		*/
+		void complete(uint64_t value, int32_t res);
+#endif
 	private:
 		void write(char * buf, size_t len);
+		/* serialize entries in [@from, @to) into @buf */
+		void serialize(w_int_t from, w_int_t to, char * buf);
+#ifdef WHALE_HAVE_IO_URING
+		void submit_batch(w_int_t from, w_int_t to, size_t len);
+		void finish_batch(log_batch_t & b);
+		void retire_batches();
+		uring                      *ring = nullptr;
+		std::unique_ptr<char[]>     slots;
+		bool                        slot_busy[WHALE_LOG_SLOTS] = {};
+		std::deque<log_batch_t>     inflight;
+		w_uint_t                    batch_seq = 0;
+#endif
 		std::string					log_file;
 		w_int_t 					fd;
 		/* index of next entry in @entries to commit */
 		w_int_t                     commit_idx;
 		off_t                       pos;
+		w_int_t                     durable_idx;
 		std::vector<log_entry_t> 	entries;
 	};
 
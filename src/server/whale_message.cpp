@@ -20,14 +20,14 @@ namespace whale {
 										"\"data\":\"%s\"}",
 										entry.term,
 										entry.index,
-										entry.data.c_str()));
+										json_escape(entry.data).c_str()));
 	}
 
 	static std::string log_entries_to_json(const std::string & key_name,
 										   const std::vector<log_entry> logs) {
-		std::string json = key_name + ":[";
+		std::string json = "\"" + key_name + "\":[";
 		for (const log_entry & entry : logs) {
-			if (json.size() > key_name.size() + 2) {
+			if (json.size() > key_name.size() + 4) {
 				json.append(",");
 			}
 
@@ -41,17 +41,21 @@ namespace whale {
 	make_msg_from_request_vote(const request_vote_t & r) {
 		std::string  json(std::move(string_format("{\"term\":%d,%s,"
 							"\"last_log_idx\":%d,"
-							"\"last_log_term\":%d}",
+							"\"last_log_term\":%d,"
+							"\"rpc_id\":%lu,"
+							"\"transfer\":%d}",
 							r.term,
 							std::move(w_addr_to_json("candidate_id", r.candidate_id)).c_str(),
 							r.last_log_idx,
-							r.last_log_term
+							r.last_log_term,
+							r.rpc_id,
+							r.transfer
 							)));
 		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
 
-		m->msg_type = ::htonl(MESSAGE_REQUEST_VOTE);
+		m->msg_type = ::htonl(r.pre_vote ? MESSAGE_PRE_VOTE : MESSAGE_REQUEST_VOTE);
 		m->len = ::htonl(sizeof(message_t) + json.size());
-		strcpy(m->data, json.c_str());
+		memcpy(m->data, json.data(), json.size());
 
 		return m;
 	}
@@ -59,14 +63,17 @@ namespace whale {
 	message_t *
 	make_msg_from_request_vote_res(const request_vote_res_t & r) {
 		std::string  json(std::move(string_format("{\"term\":%d,"
-							"\"vote_granted\":%d}",
+							"\"vote_granted\":%d,"
+							"\"rpc_id\":%lu}",
 							r.term,
-							r.vote_granted)));
+							r.vote_granted,
+							r.rpc_id)));
 		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
 
-		m->msg_type = ::htonl(MESSAGE_REQUEST_VOTE_RES);
+		m->msg_type = ::htonl(r.pre_vote ? MESSAGE_PRE_VOTE_RES
+		                                 : MESSAGE_REQUEST_VOTE_RES);
 		m->len = ::htonl(sizeof(message_t) + json.size());
-		strcpy(m->data, json.c_str());
+		memcpy(m->data, json.data(), json.size());
 
 		return m;
 	}
@@ -74,23 +81,113 @@ namespace whale {
 	message_t *
 	make_msg_from_append_entries(const append_entries_t & r) {
 		std::string  json(std::move(string_format("{\"term\":%d,%s,"
-							"\"prev_log_idx\":%d"
+							"\"prev_log_idx\":%d,"
 							"\"prev_log_term\":%d,"
 							"%s,"
-							"\"leader_commit\":%d,}"
-							"\"heartbeat\": %d}",
+							"\"leader_commit\":%d,"
+							"\"heartbeat\":%d,"
+							"\"rpc_id\":%lu}",
 							r.term,
 							std::move(w_addr_to_json("leader_id", r.leader_id)).c_str(),
 							r.prev_log_idx,
 							r.prev_log_term,
 							std::move(log_entries_to_json("entries", r.entries)).c_str(),
 							r.leader_commit,
-							r.heartbeat)));
+							r.heartbeat,
+							r.rpc_id)));
 		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
 
 		m->msg_type = ::htonl(MESSAGE_APPEND_ENTRIES);
 		m->len = ::htonl(sizeof(message_t) + json.size());
-		strcpy(m->data, json.c_str());
+		memcpy(m->data, json.data(), json.size());
+
+		return m;
+	}
+
+	message_t *
+	make_msg_from_forward_cmds(const forward_cmds_t & f) {
+		std::string json = "{\"cmds\":[";
+
+		for (const forward_cmd_t & c : f.cmds) {
+			if (json.size() > sizeof("{\"cmds\":[") - 1)
+				json.append(",");
+
+			json.append(std::move(string_format("{\"id\":%lu,\"cmd\":\"%s\"}",
+			                                    c.id, json_escape(c.cmd).c_str())));
+		}
+
+		json.append("]}");
+
+		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
+
+		m->msg_type = ::htonl(MESSAGE_FORWARD_CMD);
+		m->len = ::htonl(sizeof(message_t) + json.size());
+		memcpy(m->data, json.data(), json.size());
+
+		return m;
+	}
+
+	message_t *
+	make_msg_from_forward_cmds_res(const forward_cmds_res_t & f) {
+		std::string json = "{\"results\":[";
+
+		for (const forward_res_t & r : f.results) {
+			if (json.size() > sizeof("{\"results\":[") - 1)
+				json.append(",");
+
+			json.append(std::move(string_format("{\"id\":%lu,\"res\":%d,"
+			                                    "\"index\":%ld}",
+			                                    r.id, r.res, r.index)));
+		}
+
+		json.append("]}");
+
+		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
+
+		m->msg_type = ::htonl(MESSAGE_FORWARD_CMD_RES);
+		m->len = ::htonl(sizeof(message_t) + json.size());
+		memcpy(m->data, json.data(), json.size());
+
+		return m;
+	}
+
+	message_t *
+	make_msg_from_timeout_now(const timeout_now_t & t) {
+		std::string  json(std::move(string_format("{\"term\":%d}", t.term)));
+		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
+
+		m->msg_type = ::htonl(MESSAGE_TIMEOUT_NOW);
+		m->len = ::htonl(sizeof(message_t) + json.size());
+		memcpy(m->data, json.data(), json.size());
+
+		return m;
+	}
+
+	message_t *
+	make_msg_from_read_index(const read_index_t & r) {
+		std::string  json(std::move(string_format("{\"id\":%lu}", r.id)));
+		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
+
+		m->msg_type = ::htonl(MESSAGE_READ_INDEX);
+		m->len = ::htonl(sizeof(message_t) + json.size());
+		memcpy(m->data, json.data(), json.size());
+
+		return m;
+	}
+
+	message_t *
+	make_msg_from_read_index_res(const read_index_res_t & r) {
+		std::string  json(std::move(string_format("{\"id\":%lu,"
+							"\"index\":%d,"
+							"\"ok\":%d}",
+							r.id,
+							r.index,
+							r.ok)));
+		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
+
+		m->msg_type = ::htonl(MESSAGE_READ_INDEX_RES);
+		m->len = ::htonl(sizeof(message_t) + json.size());
+		memcpy(m->data, json.data(), json.size());
 
 		return m;
 	}
@@ -98,17 +195,21 @@ namespace whale {
 	message_t *
 	make_msg_from_append_entries_res(const append_entries_res_t & r) {
 		std::string  json(std::move(string_format("{\"term\":%d,"
-							"\"success\":%d"
-							"\"heartbeat\":%d}",
+							"\"success\":%d,"
+							"\"heartbeat\":%d,"
+							"\"match_idx\":%d,"
+							"\"rpc_id\":%lu}",
 							r.term,
 							r.success,
-							r.heartbeat)));
+							r.heartbeat,
+							r.match_idx,
+							r.rpc_id)));
 
 		message_t * m = reinterpret_cast<message_t *>(new char[sizeof(message_t) + json.size()]);
 
 		m->msg_type = ::htonl(MESSAGE_APPEND_ENTRIES_RES);
 		m->len = ::htonl(sizeof(message_t) + json.size());
-		strcpy(m->data, json.c_str());
+		memcpy(m->data, json.data(), json.size());
 
 		return m;
 	}
@@ -121,6 +222,8 @@ namespace whale {
 		std::unique_ptr<request_vote_t>  r;
 		char                             ip_buf[50] = {0};
 		w_int_t                          port;
+		w_int_t                          rpc_id;
+		w_int_t                          transfer = 0;
 		
 		if (xson_init(&ctx, m.data))
 			return nullptr;
@@ -145,6 +248,16 @@ namespace whale {
 		if (xson_get_intptr_by_expr(root, "candidate_id.port", &port))
 			return nullptr;
 
+		if (xson_get_intptr_by_expr(root, "rpc_id", &rpc_id))
+			return nullptr;
+
+		/* older servers don't send it */
+		xson_get_intptr_by_expr(root, "transfer", &transfer);
+
+		r->rpc_id = rpc_id;
+		r->pre_vote = ::ntohl(m.msg_type) == MESSAGE_PRE_VOTE;
+		r->transfer = transfer;
+
 		inet_aton(ip_buf, &r->candidate_id.addr.sin_addr);
 		r->candidate_id.addr.sin_port = ::htons(port);
 
@@ -157,6 +270,7 @@ namespace whale {
 		struct xson_element                 *root;
 		std::unique_ptr<request_vote_res_t>  r;
 		w_int_t                              vote_granted;
+		w_int_t                              rpc_id;
 
 		if (xson_init(&ctx, m.data))
 			return nullptr;
@@ -172,7 +286,12 @@ namespace whale {
 		if (xson_get_intptr_by_expr(root, "vote_granted", &vote_granted))
 			return nullptr;
 
+		if (xson_get_intptr_by_expr(root, "rpc_id", &rpc_id))
+			return nullptr;
+
 		r->vote_granted = vote_granted;
+		r->rpc_id = rpc_id;
+		r->pre_vote = ::ntohl(m.msg_type) == MESSAGE_PRE_VOTE_RES;
 
 		return r.release();
 	}
@@ -187,6 +306,7 @@ namespace whale {
 		w_int_t                            port;
 		w_int_t                            array_size;
 		w_int_t                            heartbeat;
+		w_int_t                            rpc_id;
 
 		if (xson_init(&ctx, m.data))
 			return nullptr;
@@ -194,6 +314,8 @@ namespace whale {
 		if (xson_parse(&ctx, &root) != XSON_RESULT_SUCCESS)
 			return nullptr;
 
+		a = std::unique_ptr<append_entries_t>(new append_entries_t);
+
 		if (xson_get_intptr_by_expr(root, "term", &a->term))
 			return nullptr;
 
@@ -215,28 +337,38 @@ namespace whale {
 		if (xson_get_intptr_by_expr(root, "heartbeat", &heartbeat))
 			return nullptr;
 
+		if (xson_get_intptr_by_expr(root, "rpc_id", &rpc_id))
+			return nullptr;
+
 		inet_aton(ip_buf, &a->leader_id.addr.sin_addr);
 		a->leader_id.addr.sin_port = ::htons(port);
 		a->heartbeat = heartbeat;
+		a->rpc_id = rpc_id;
 
 		array_size = xson_get_arraysize_by_expr(root, "entries");
 
 		for(int i = 0; i < array_size; ++i) {
 			int                  string_size;
 			std::unique_ptr<char[]>  p;
+			w_int_t              val;
 
 			a->entries.push_back(log_entry());
 
+			/* entry fields are 32 bits wide, don't let xson write past them */
 			sprintf(expr_buf, "entries[%d].term", i);
 
-			if (xson_get_intptr_by_expr(root, expr_buf, (intptr_t*)&a->entries.back().term))
+			if (xson_get_intptr_by_expr(root, expr_buf, &val))
 				return nullptr;
 
+			a->entries.back().term = val;
+
 			sprintf(expr_buf, "entries[%d].index", i);
 
-			if (xson_get_intptr_by_expr(root, expr_buf, (intptr_t*)&a->entries.back().index))
+			if (xson_get_intptr_by_expr(root, expr_buf, &val))
 				return nullptr;
 
+			a->entries.back().index = val;
+
 			sprintf(expr_buf, "entries[%d].data", i);
 
 			string_size = xson_get_stringsize_by_expr(root, expr_buf);
@@ -262,6 +394,7 @@ namespace whale {
 		std::unique_ptr<append_entries_res_t>  a;
 		w_int_t                                success;
 		w_int_t                                heartbeat;
+		w_int_t                                rpc_id;
 
 		if (xson_init(&ctx, m.data))
 			return nullptr;
@@ -280,9 +413,181 @@ namespace whale {
 		if (xson_get_intptr_by_expr(root, "heartbeat", &heartbeat))
 			return nullptr;
 
+		if (xson_get_intptr_by_expr(root, "match_idx", &a->match_idx))
+			return nullptr;
+
+		if (xson_get_intptr_by_expr(root, "rpc_id", &rpc_id))
+			return nullptr;
+
 		a->success = success;
 		a->heartbeat = heartbeat;
+		a->rpc_id = rpc_id;
 
 		return a.release();
 	}
+
+	forward_cmds_t *
+	make_forward_cmds_from_msg(const message_t & m) {
+		struct xson_context              ctx;
+		struct xson_element             *root;
+		std::unique_ptr<forward_cmds_t>  f;
+		char                             expr_buf[50] = {0};
+		w_int_t                          array_size;
+
+		if (xson_init(&ctx, m.data))
+			return nullptr;
+		
+		if (xson_parse(&ctx, &root) != XSON_RESULT_SUCCESS)
+			return nullptr;
+
+		f = std::unique_ptr<forward_cmds_t>(new forward_cmds_t);
+
+		array_size = xson_get_arraysize_by_expr(root, "cmds");
+
+		for (int i = 0; i < array_size; ++i) {
+			int                      string_size;
+			std::unique_ptr<char[]>  p;
+			w_int_t                  id;
+
+			sprintf(expr_buf, "cmds[%d].id", i);
+
+			if (xson_get_intptr_by_expr(root, expr_buf, &id))
+				return nullptr;
+
+			sprintf(expr_buf, "cmds[%d].cmd", i);
+
+			string_size = xson_get_stringsize_by_expr(root, expr_buf);
+
+			if (string_size < 0)
+				return nullptr;
+
+			p = std::unique_ptr<char[]>(new char[string_size]);
+
+			if (xson_get_string_by_expr(root, expr_buf, p.get(), string_size))
+				return nullptr;
+
+			f->cmds.push_back({(w_uint_t)id, std::string(p.get(), string_size)});
+		}
+
+		return f.release();
+	}
+
+	forward_cmds_res_t *
+	make_forward_cmds_res_from_msg(const message_t & m) {
+		struct xson_context                  ctx;
+		struct xson_element                 *root;
+		std::unique_ptr<forward_cmds_res_t>  f;
+		char                                 expr_buf[50] = {0};
+		w_int_t                              array_size;
+
+		if (xson_init(&ctx, m.data))
+			return nullptr;
+		
+		if (xson_parse(&ctx, &root) != XSON_RESULT_SUCCESS)
+			return nullptr;
+
+		f = std::unique_ptr<forward_cmds_res_t>(new forward_cmds_res_t);
+
+		array_size = xson_get_arraysize_by_expr(root, "results");
+
+		for (int i = 0; i < array_size; ++i) {
+			w_int_t id;
+			w_int_t res;
+			w_int_t index;
+
+			sprintf(expr_buf, "results[%d].id", i);
+
+			if (xson_get_intptr_by_expr(root, expr_buf, &id))
+				return nullptr;
+
+			sprintf(expr_buf, "results[%d].res", i);
+
+			if (xson_get_intptr_by_expr(root, expr_buf, &res))
+				return nullptr;
+
+			/* leaders before session reads don't send it */
+			sprintf(expr_buf, "results[%d].index", i);
+
+			if (xson_get_intptr_by_expr(root, expr_buf, &index))
+				index = 0;
+
+			f->results.push_back({(w_uint_t)id, res != 0, index});
+		}
+
+		return f.release();
+	}
+
+	timeout_now_t *
+	make_timeout_now_from_msg(const message_t & m) {
+		struct xson_context             ctx;
+		struct xson_element            *root;
+		std::unique_ptr<timeout_now_t>  t;
+
+		if (xson_init(&ctx, m.data))
+			return nullptr;
+		
+		if (xson_parse(&ctx, &root) != XSON_RESULT_SUCCESS)
+			return nullptr;
+
+		t = std::unique_ptr<timeout_now_t>(new timeout_now_t);
+
+		if (xson_get_intptr_by_expr(root, "term", &t->term))
+			return nullptr;
+
+		return t.release();
+	}
+
+	read_index_t *
+	make_read_index_from_msg(const message_t & m) {
+		struct xson_context            ctx;
+		struct xson_element           *root;
+		std::unique_ptr<read_index_t>  r;
+		w_int_t                        id;
+
+		if (xson_init(&ctx, m.data))
+			return nullptr;
+		
+		if (xson_parse(&ctx, &root) != XSON_RESULT_SUCCESS)
+			return nullptr;
+
+		r = std::unique_ptr<read_index_t>(new read_index_t);
+
+		if (xson_get_intptr_by_expr(root, "id", &id))
+			return nullptr;
+
+		r->id = id;
+
+		return r.release();
+	}
+
+	read_index_res_t *
+	make_read_index_res_from_msg(const message_t & m) {
+		struct xson_context                ctx;
+		struct xson_element               *root;
+		std::unique_ptr<read_index_res_t>  r;
+		w_int_t                            id;
+		w_int_t                            ok;
+
+		if (xson_init(&ctx, m.data))
+			return nullptr;
+		
+		if (xson_parse(&ctx, &root) != XSON_RESULT_SUCCESS)
+			return nullptr;
+
+		r = std::unique_ptr<read_index_res_t>(new read_index_res_t);
+
+		if (xson_get_intptr_by_expr(root, "id", &id))
+			return nullptr;
+
+		if (xson_get_intptr_by_expr(root, "index", &r->index))
+			return nullptr;
+
+		if (xson_get_intptr_by_expr(root, "ok", &ok))
+			return nullptr;
+
+		r->id = id;
+		r->ok = ok;
+
+		return r.release();
+	}
 }
\ No newline at end of file
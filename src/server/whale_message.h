@@ -25,7 +25,9 @@ namespace whale {
 	*		"port" : 8888
 	*	},
 	*	"last_log_idx" : 1,
-	*	"last_log_term" : 2
+	*	"last_log_term" : 2,
+	*	"rpc_id" : 7,
+	*	"transfer" : 0
 	* }
 	*/
 	typedef struct request_vote_s {
@@ -33,6 +35,9 @@ namespace whale {
 		w_addr_t	candidate_id;	/* candidate requesting vote */
 		w_int_t		last_log_idx;	/* index of candidate's last log entry */
 		w_int_t		last_log_term;	/* term of candidate's last log entry */
+		w_uint_t	rpc_id;			/* echoed by the reply to pair it with the request */
+		bool		pre_vote;		/* only asks if a vote would be granted, sent as MESSAGE_PRE_VOTE */
+		bool		transfer;		/* the leader handed leadership over, see read_lease */
 	} request_vote_t;
 
 	typedef std::shared_ptr<request_vote_t> rv_sptr;
@@ -42,12 +47,15 @@ namespace whale {
 	* JSON format: 
 	* {
 	*	"term" : 1,
-	*	"vote_granted" : true
+	*	"vote_granted" : true,
+	*	"rpc_id" : 7
 	* }
 	*/
 	typedef struct request_vote_res_s {
 		w_int_t		term;			/* current term on the server, for candidate to update itself */
 		bool		vote_granted;	/* true if candidate got a vote */
+		w_uint_t	rpc_id;			/* rpc_id of the request */
+		bool		pre_vote;		/* answers a pre-vote, sent as MESSAGE_PRE_VOTE_RES */
 	} request_vote_res_t;
 	
 	typedef std::shared_ptr<request_vote_res_t> rvr_sptr;
@@ -74,7 +82,9 @@ namespace whale {
 	*			"data"  : "add a 1"
 	*		}
 	*	],
-	*	"leader_commit": 2
+	*	"leader_commit": 2,
+	*	"heartbeat" : false,
+	*	"rpc_id" : 8
 	* }
 	*/
 	typedef struct append_entries_s {
@@ -85,6 +95,7 @@ namespace whale {
 		std::vector<log_entry> 	entries;		/* log entries to store (empty for heartbeat message) */
 		w_int_t					leader_commit;	/* leader's commit_idx */
 		bool                    heartbeat;      /* if this is a hearbeat request */
+		w_uint_t                rpc_id;         /* echoed by the reply to pair it with the request */
 	} append_entries_t;
 
 	typedef std::shared_ptr<append_entries_t> ae_sptr;
@@ -94,26 +105,136 @@ namespace whale {
 	* JSON format: 
 	* {
 	*	"term" : 1,
-	*	"success" : true
+	*	"success" : true,
+	*	"heartbeat" : false,
+	*	"match_idx" : 2,
+	*	"rpc_id" : 8
 	* }
 	*/
 	typedef struct append_entries_res_s {
 		w_int_t		term;		/* current term on the server, for candidate to update itself */
 		bool        heartbeat;  /* if this is a hearbeat reply */
 		bool		success;	/* true if follower contained entry matching prev_log_idx and prev_log_term*/
+		w_int_t     match_idx;  /* index of follower's last log entry known to match the leader's */
+		w_uint_t    rpc_id;     /* rpc_id of the request */
 	} append_entries_res_t;
 
 	typedef std::shared_ptr<append_entries_res_t> aer_sptr;
 	typedef std::unique_ptr<append_entries_res_t> aer_uptr;
 
+	/*
+	* client commands a follower forwards to the leader.
+	* JSON format: 
+	* {
+	*	"cmds":[
+	*		{
+	*			"id"  : 1,
+	*			"cmd" : "set a 1"
+	*		},
+	*		{
+	*			"id"  : 2,
+	*			"cmd" : "add a 1"
+	*		}
+	*	]
+	* }
+	*/
+	typedef struct forward_cmd_s {
+		w_uint_t    id;     /* chosen by the follower to route the result back */
+		std::string cmd;    /* the client's command */
+	} forward_cmd_t;
+
+	typedef struct forward_cmds_s {
+		std::vector<forward_cmd_t> cmds;
+	} forward_cmds_t;
+
+	typedef std::unique_ptr<forward_cmds_t> fc_uptr;
+
+	/*
+	* JSON format: 
+	* {
+	*	"results":[
+	*		{
+	*			"id"    : 1,
+	*			"res"   : true,
+	*			"index" : 42
+	*		}
+	*	]
+	* }
+	*/
+	typedef struct forward_res_s {
+		w_uint_t    id;     /* id of the forwarded command */
+		bool        res;    /* true if the command was committed */
+		w_int_t     index;  /* where it was committed */
+	} forward_res_t;
+
+	typedef struct forward_cmds_res_s {
+		std::vector<forward_res_t> results;
+	} forward_cmds_res_t;
+
+	typedef std::unique_ptr<forward_cmds_res_t> fcr_uptr;
+
+	/*
+	* the leader handing leadership over tells the follower to start
+	* an election right away.
+	* JSON format: 
+	* {
+	*	"term" : 1
+	* }
+	*/
+	typedef struct timeout_now_s {
+		w_int_t     term;   /* leader's term */
+	} timeout_now_t;
+
+	typedef std::unique_ptr<timeout_now_t> tn_uptr;
+
+	/*
+	* a follower asks for a read index, for every read that came in
+	* since its last request.
+	* JSON format: 
+	* {
+	*	"id" : 3
+	* }
+	*/
+	typedef struct read_index_s {
+		w_uint_t    id;     /* chosen by the follower, echoed by the reply */
+	} read_index_t;
+
+	typedef std::unique_ptr<read_index_t> ri_uptr;
+
+	/*
+	* JSON format: 
+	* {
+	*	"id" : 3,
+	*	"index" : 42,
+	*	"ok" : true
+	* }
+	*/
+	typedef struct read_index_res_s {
+		w_uint_t    id;     /* id of the request */
+		w_int_t     index;  /* reads are served once the follower applied this far */
+		bool        ok;     /* false if not the leader */
+	} read_index_res_t;
+
+	typedef std::unique_ptr<read_index_res_t> rir_uptr;
+
 	message_t * make_msg_from_request_vote(const request_vote_t & r);
 	message_t * make_msg_from_request_vote_res(const request_vote_res_t & r);
 	message_t * make_msg_from_append_entries(const append_entries_t & r);
 	message_t * make_msg_from_append_entries_res(const append_entries_res_t & r);
+	message_t * make_msg_from_forward_cmds(const forward_cmds_t & f);
+	message_t * make_msg_from_forward_cmds_res(const forward_cmds_res_t & f);
+	message_t * make_msg_from_timeout_now(const timeout_now_t & t);
+	message_t * make_msg_from_read_index(const read_index_t & r);
+	message_t * make_msg_from_read_index_res(const read_index_res_t & r);
 
 	request_vote_t 		* make_request_vote_from_msg(const message_t & m);
 	request_vote_res_t 	* make_request_vote_res_from_msg(const message_t & m);
 	append_entries_t 	* make_append_entries_from_msg(const message_t & m);
 	append_entries_res_t * make_append_entries_res_from_msg(const message_t & m);
+	forward_cmds_t 		* make_forward_cmds_from_msg(const message_t & m);
+	forward_cmds_res_t 	* make_forward_cmds_res_from_msg(const message_t & m);
+	timeout_now_t 		* make_timeout_now_from_msg(const message_t & m);
+	read_index_t 		* make_read_index_from_msg(const message_t & m);
+	read_index_res_t 	* make_read_index_res_from_msg(const message_t & m);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,151 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <log.h>
+#include <whale_meta.h>
+
+namespace whale {
+
+	static uint32_t crc32(const void * data, size_t len) {
+		const unsigned char * p = static_cast<const unsigned char *>(data);
+		uint32_t              crc = 0xffffffff;
+
+		while (len--) {
+			crc ^= *p++;
+			for (int k = 0; k < 8; ++k)
+				crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+		}
+
+		return ~crc;
+	}
+
+	static bool record_valid(const meta_record_t & r) {
+		return r.magic == META_MAGIC && r.version == META_VERSION &&
+		       r.crc == crc32(&r, offsetof(meta_record_t, crc));
+	}
+
+	meta_store::~meta_store() {
+		if (this->fd != -1)
+			TEMP_FAILURE_RETRY(::close(this->fd));
+	}
+
+	w_rc_t meta_store::load() {
+		meta_record_t r;
+		struct stat   st;
+		bool          found = false;
+
+		this->fd = ::open(this->meta_file.c_str(), META_FILE_FLAGS, META_FILE_MODE);
+
+		if (this->fd == -1) {
+			log_error("failed to open \"%s\": %s", this->meta_file.c_str(),
+			          ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		if (::fstat(this->fd, &st)) {
+			log_error("failed to fstat \"%s\": %s", this->meta_file.c_str(),
+			          ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		for (int i = 0; i < META_SLOTS; ++i) {
+			if (::pread(this->fd, &r, sizeof(r), i * META_SLOT_SIZE) != sizeof(r) ||
+			    !record_valid(r))
+				continue;
+
+			if (!found || r.seq > this->seq) {
+				this->seq = r.seq;
+				this->term_ = r.term;
+				this->vote = r.voted_for;
+				found = true;
+			}
+		}
+
+		if (!found && st.st_size > 0 && !import_legacy(st.st_size)) {
+			log_error("no valid record in \"%s\", refusing to start over",
+			          this->meta_file.c_str());
+			return WHALE_ERROR;
+		}
+
+		return WHALE_GOOD;
+	}
+
+	/*
+	* files of older versions hold a plain 32 bit term followed by the
+	* vote, taken over and rewritten in the new format by the next sync.
+	*/
+	bool meta_store::import_legacy(off_t size) {
+		int32_t t;
+
+		if (size != sizeof(int32_t) + sizeof(struct sockaddr_in) ||
+		    ::pread(this->fd, &t, sizeof(t), 0) != sizeof(t) ||
+		    ::pread(this->fd, &this->vote, sizeof(this->vote),
+		            sizeof(t)) != sizeof(this->vote))
+			return false;
+
+		this->term_ = t;
+		this->dirty = true;
+		return sync() == WHALE_GOOD;
+	}
+
+	void meta_store::set_term(w_int_t t) {
+		if (t == this->term_)
+			return;
+
+		this->term_ = t;
+		this->vote = {};
+		this->dirty = true;
+	}
+
+	void meta_store::set_vote(const struct sockaddr_in & addr) {
+		if (this->vote.sin_addr.s_addr == addr.sin_addr.s_addr &&
+		    this->vote.sin_port == addr.sin_port)
+			return;
+
+		this->vote = addr;
+		this->dirty = true;
+	}
+
+	w_rc_t meta_store::sync() {
+		meta_record_t r;
+		ssize_t       nwrite;
+
+		if (!this->dirty)
+			return WHALE_GOOD;
+
+		::memset(&r, 0, sizeof(r));
+		r.magic = META_MAGIC;
+		r.version = META_VERSION;
+		r.seq = this->seq + 1;
+		r.term = this->term_;
+		r.voted_for = this->vote;
+		r.crc = crc32(&r, offsetof(meta_record_t, crc));
+
+		nwrite = TEMP_FAILURE_RETRY(::pwrite(this->fd, &r, sizeof(r),
+		                                     (r.seq % META_SLOTS) * META_SLOT_SIZE));
+
+		if (nwrite != sizeof(r)) {
+			log_error("failed to write \"%s\": %s", this->meta_file.c_str(),
+			          nwrite == -1 ? ::strerror(errno) : "short write");
+			return WHALE_ERROR;
+		}
+
+		if (::fdatasync(this->fd)) {
+			log_error("failed to fdatasync \"%s\": %s", this->meta_file.c_str(),
+			          ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		this->seq = r.seq;
+		this->dirty = false;
+		++this->syncs;
+		return WHALE_GOOD;
+	}
+}
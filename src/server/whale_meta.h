@@ -0,0 +1,87 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef WHALE_META_H_
+#define WHALE_META_H_
+
+#include <string>
+
+#include <netinet/in.h>
+
+#include <define.h>
+
+namespace whale {
+
+	#define META_FILE_MODE      S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH
+	#define META_FILE_FLAGS     O_CREAT | O_RDWR | O_CLOEXEC
+	#define META_MAGIC          0x57484d54   /* "WHMT" */
+	#define META_VERSION        1
+	/* records alternate between two slots, each within one sector */
+	#define META_SLOT_SIZE      512
+	#define META_SLOTS          2
+
+	/* one on-disk copy of the metadata */
+	typedef struct meta_record_s {
+		uint32_t           magic;
+		uint32_t           version;
+		/* bumped on every write, the valid record with the highest wins */
+		uint64_t           seq;
+		int64_t            term;
+		struct sockaddr_in voted_for;
+		/* crc32 of all the fields above */
+		uint32_t           crc;
+	} meta_record_t;
+
+	/*
+	* Durable current term and vote.
+	*
+	* Updates only change the in-memory copy. sync() writes a new
+	* checksummed record into the slot the previous one didn't use,
+	* with one pwrite and one fdatasync, so a torn write never destroys
+	* the last good record. Nothing is written if nothing changed, so
+	* a term bump and a vote made together cost one sync.
+	*/
+	class meta_store {
+	public:
+		meta_store(std::string meta_filename)
+			:meta_file(meta_filename), fd(-1), seq(0), term_(0),
+			 dirty(false), syncs(0) {
+			vote = {};
+		}
+		~meta_store();
+
+		/*
+		* open the file and load the newest valid record.
+		* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+		*/
+		w_rc_t load();
+
+		w_int_t term() const { return term_; }
+		const struct sockaddr_in & voted_for() const { return vote; }
+
+		/* move on to term @t, forgetting the vote of the previous one */
+		void set_term(w_int_t t);
+		void set_vote(const struct sockaddr_in & addr);
+
+		/*
+		* make the updates since the last sync durable.
+		* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+		*/
+		w_rc_t sync();
+
+		/* number of syncs that actually hit the disk */
+		w_uint_t sync_count() const { return syncs; }
+	private:
+		bool import_legacy(off_t size);
+
+		std::string        meta_file;
+		int                fd;
+		uint64_t           seq;
+		w_int_t            term_;
+		struct sockaddr_in vote;
+		bool               dirty;
+		w_uint_t           syncs;
+	};
+}
+#endif
@@ -1,14 +1,18 @@
 /*
 * Copyright (C) Xinjing Cho
 */
+#include <algorithm>
+#include <functional>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <csignal>
 
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <netdb.h>
 
 #include <log.h>
 
@@ -49,26 +53,46 @@ namespace whale {
 
 	/*
 	* create a tcp socket and listen on it.
+	* @opts: options of the accepted connections, they inherit them
+	*        from the listening socket.
+	* @reuseport: let other sockets bind the same address, the kernel
+	*            spreads incoming connections over them.
 	* Return: file descriptor of that socket on success, -1 on failure.
 	*/
-	static el_socket_t make_listen_fd(w_addr_t * addr) {
+	static el_socket_t make_listen_fd(w_addr_t * addr, w_int_t backlog,
+	                                  const sock_opts_t & opts,
+	                                  bool reuseport = false) {
 		el_socket_t fd;
+		int         on = 1;
 
-		fd = ::socket(AF_INET, SOCK_STREAM, 0);
+		fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
 		if (fd == -1) {
 			log_error("failed to ::socket: %s", ::strerror(errno));
 			return -1;
 		}
 
+		if (reuseport &&
+		    ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+			log_error("failed to set SO_REUSEPORT: %s", ::strerror(errno));
+			TEMP_FAILURE_RETRY(close(fd));
+			return -1;
+		}
+
+		/* before listen(), the window scale is fixed by the buffer size */
+		if (apply_sock_opts(fd, opts) != WHALE_GOOD)
+			log_error("listening fd[%d] runs with default socket options", fd);
+
 		if (::bind(fd, (struct sockaddr*)&addr->addr,
 		           sizeof(struct sockaddr))) {
 			log_error("failed to ::bind: %s", ::strerror(errno));
+			TEMP_FAILURE_RETRY(close(fd));
 			return -1;
 		}
 		
-		if (::listen(fd, WHALE_BACKLOG)) {
+		if (::listen(fd, backlog)) {
 			log_error("failed to ::listen: %s", ::strerror(errno));
+			TEMP_FAILURE_RETRY(close(fd));
 			return -1;
 		}
 
@@ -110,6 +134,7 @@ namespace whale {
 	*/
 	static el_socket_t connect_to_peer(peer_t & peer) {
 		el_socket_t        fd;
+		struct sockaddr_in local;
 
 		fd = ::socket(AF_INET, SOCK_STREAM, 0);
 
@@ -123,6 +148,23 @@ namespace whale {
 			goto fail;
 		}
 
+		if (apply_sock_opts(fd, peer.server->get_peer_sock_opts()) != WHALE_GOOD)
+			log_error("peer fd[%d] runs with default socket options", fd);
+
+		/*
+		* connect from listen_ip, peers tell us apart by source address.
+		* this also lets several nodes share one host on loopback aliases.
+		*/
+		local = peer.server->get_self().addr;
+		local.sin_family = AF_INET;
+		local.sin_port = 0;
+
+		if (::bind(fd, (struct sockaddr*)&local, sizeof(struct sockaddr_in))) {
+			log_error("failed to ::bind fd[%d] to listen_ip: %s",
+			          fd, ::strerror(errno));
+			goto fail;
+		}
+
 		if (::connect(fd, (struct sockaddr*)&peer.addr.addr,
 			          sizeof(struct sockaddr))) {
 			if (errno != EINPROGRESS) {
@@ -173,7 +215,7 @@ namespace whale {
 	}
 
 	/*
-	* gets called when candidate or leader sends data as a follower.
+	* handles read and write messages from/to a peer or a client.
 	*/
 	static void
 	peer_callback(el_socket_t fd, short res_flags, void *arg) {
@@ -193,27 +235,153 @@ namespace whale {
 	* gets called to send heartbeat to servers
 	*/
 	static void
-	hearbeat_callback(el_socket_t fd, short res_flags, void *arg) {
+	hearbeat_callback(void *arg) {
 		whale_server * s = static_cast<whale_server*>(arg);
 		s->send_heartbeat();
 		s->reset_heartbeat_timer();
 	}
 
 	/*
-	* handles read and write messages from/to a peer as a candidate or leader.
+	* gets called on the reactor iteration after a client command was
+	* queued for forwarding, so commands of every client that became
+	* readable meanwhile share one message to the leader.
 	*/
 	static void
-	server_callback(el_socket_t fd, short res_flags, void *arg) {
-		peer_t       *peer = static_cast<peer_t*>(arg);
-		whale_server *s = peer->server;
+	forward_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->flush_forward_batch();
+	}
 
-		if (res_flags & E_READ) {
-			s->handle_read_from_peer(peer);
-		}
+	/*
+	* gets called on the reactor iteration after a follower read came
+	* in, so the reads of that iteration share one read index request.
+	*/
+	static void
+	read_index_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->flush_read_index();
+	}
 
-		if (res_flags & E_WRITE) {
-			s->handle_write_to_peer(peer);
-		}
+	/*
+	* gets called every peer_stats_interval ms to log peer gauges.
+	*/
+	static void
+	peer_stats_callback(void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->dump_peer_stats();
+	}
+
+#ifdef WHALE_HAVE_IO_URING
+	/*
+	* gets called when the ring posted completions.
+	*/
+	static void
+	uring_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->handle_uring_completions();
+	}
+
+	/*
+	* gets called on the reactor iteration after sends got queued to the
+	* ring, so they reach the kernel in one io_uring_enter.
+	*/
+	static void
+	uring_submit_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->submit_uring();
+	}
+#endif
+
+	/*
+	* gets called when acceptor threads handed us new clients.
+	*/
+	static void
+	accepted_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->handle_accepted();
+	}
+
+	/*
+	* gets called when io workers handed us client requests.
+	*/
+	static void
+	worker_events_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->handle_worker_events();
+	}
+
+	/*
+	* gets called every WHALE_TIMER_TICK ms to turn the timer wheel.
+	*/
+	static void
+	tick_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->handle_tick();
+	}
+
+	/*
+	* gets called on SIGUSR1 to hand leadership over.
+	*/
+	static void
+	transfer_signal_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->handle_transfer_signal();
+	}
+
+	/*
+	* gets called on SIGHUP to move the membership to the peers line.
+	*/
+	static void
+	conf_signal_callback(el_socket_t fd, short res_flags, void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->handle_conf_signal();
+	}
+
+	/*
+	* gets called once a configuration entry committed, to go on
+	* with the next membership change.
+	*/
+	static void
+	conf_change_callback(void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->change_membership();
+	}
+
+	/*
+	* gets called every election timeout on the leader to see whether
+	* a majority still answers.
+	*/
+	static void
+	quorum_check_callback(void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->check_leader_quorum();
+	}
+
+	/*
+	* gets called when a leadership transfer didn't finish in time.
+	*/
+	static void
+	transfer_timeout_callback(void *arg) {
+		whale_server * s = static_cast<whale_server*>(arg);
+		s->abort_transfer();
+	}
+
+	/*
+	* gets called when a peer didn't answer a request in time.
+	*/
+	static void
+	rpc_timeout_callback(void *arg) {
+		rpc_t * rpc = static_cast<rpc_t*>(arg);
+		rpc->p->server->rpc_timed_out(rpc);
+	}
+
+	/*
+	* gets called when a client command got no answer in time.
+	*/
+	static void
+	client_deadline_callback(void *arg) {
+		peer_t * client = static_cast<peer_t*>(arg);
+		client->server->client_timed_out(client);
 	}
 
 	/*
@@ -221,9 +389,9 @@ namespace whale {
 	* NEXT_TIMEOUT call.
 	*/
 	static void
-	elec_timeout_callback(el_socket_t fd, short res_flags, void *arg) {
+	elec_timeout_callback(void *arg) {
 		whale_server * s = static_cast<whale_server*>(arg);
-		s->turn_into_candidate();
+		s->start_pre_vote();
 	}
 
 	/*
@@ -231,7 +399,7 @@ namespace whale {
 	* to those peers not connected to this machine yet.
 	*/
 	static void 
-	peer_reconnect_callback(el_socket_t, short res_flags, void*arg){
+	peer_reconnect_callback(void *arg){
 		peer_t * peer = static_cast<peer_t*>(arg);
 
 		if(peer->connected) return;
@@ -271,41 +439,143 @@ namespace whale {
 		return cnt == 4;
 	}
 
-	static const char * get_peer_hostname(w_addr_t & addr) {
-		struct hostent * e;
+	/*
+	* parses space separated ip[:port] of @line into @voters, those
+	* after a "/" into @learners. @port is used for those without one.
+	* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+	*/
+	static w_rc_t parse_members(const std::string & line, w_int_t port,
+	                            std::vector<w_addr_t> & voters,
+	                            std::vector<w_addr_t> & learners) {
+		std::unique_ptr<char[]> b{new char[line.size() + 1]};
+		std::vector<w_addr_t>  *out = &voters;
+		char                   *save_ptr;
+		char                   *p;
+
+		::strcpy(b.get(), line.c_str());
+
+		for (p = ::strtok_r(b.get(), " ", &save_ptr); p;
+		     p = ::strtok_r(NULL, " ", &save_ptr)) {
+			w_addr_t a;
+			char    *port_p;
+			int      n = port;
+
+			if (::strcmp(p, "/") == 0) {
+				out = &learners;
+				continue;
+			}
+
+			if (!is_ip(p)) {
+				log_error("invalid peer ip: %s", p);
+				return WHALE_ERROR;
+			}
 
-		if ((e = gethostbyaddr(&addr.addr.sin_addr, sizeof(in_addr), AF_INET)) == nullptr) {
-			log_error("error on gethostbyaddr: %s", ::hstrerror(h_errno));
-			return nullptr;
+			port_p = strchr(p, ':');
+
+			if (port_p) {
+				::sscanf(port_p + 1, "%d", &n);
+				/* leave the bare ip for ::inet_addr */
+				*port_p = '\0';
+			}
+
+			if (n > 65535 || n < 0) {
+				log_error("peer's port out of range[0-65535]");
+				return WHALE_ERROR;
+			}
+
+			::memset(&a.addr, 0, sizeof(struct sockaddr_in));
+			a.addr.sin_family = AF_INET;
+			/* convert to network byte order */
+			a.addr.sin_port = ::htons(n);
+			a.addr.sin_addr.s_addr = ::inet_addr(p);
+			a.name = w_addr_to_string(a);
+
+			out->push_back(a);
 		}
 
-		return e->h_name;
+		return WHALE_GOOD;
 	}
 
-	void whale_server::set_up_peer_events(peer_t * p, el_socket_t fd) {
-		/* connected */
-		struct event * e = &p->e;
+	/* the inverse of parse_members() */
+	static std::string format_members(const std::vector<w_addr_t> & voters,
+	                                  const std::vector<w_addr_t> & learners) {
+		std::string s;
 
-		event_set(e, fd, E_READ | E_WRITE, server_callback, p);
+		for (const w_addr_t & a : voters)
+			s += (s.empty() ? "" : " ") + w_addr_to_string(a);
 
-		if (reactor_remove_event(p->server->get_reactor(),
-		                         &p->timeout_e) == -1)
-		    log_error("failed to reactor_remove_event "
-		              " reconnecting timer event: %s", ::strerror(errno));
+		if (!learners.empty())
+			s += " /";
+		for (const w_addr_t & a : learners)
+			s += " " + w_addr_to_string(a);
 
-		/* remove @e from the reactor if @e was previously in the reactor.*/
-		if (event_in_reactor(e) &&
-		    reactor_remove_event(p->server->get_reactor(), e) == -1) {
-			log_error("failed to reactor_remove_event "
-		              " stale event: %s", ::strerror(errno));
+		return s;
+	}
+
+	/* servers are told apart by ip, like @servers does */
+	static bool has_member(const std::vector<w_addr_t> & v, const w_addr_t & a) {
+		for (const w_addr_t & m : v) {
+			if (m.addr.sin_addr.s_addr == a.addr.sin_addr.s_addr)
+				return true;
 		}
 
-		/* add @e back to the reactor. */
-		if (reactor_add_event(p->server->get_reactor(), e) == -1) {
-			log_error("failed to reactor_add_event "
-		              "new event: %s", ::strerror(errno));
+		return false;
+	}
+
+	static void remove_member(std::vector<w_addr_t> & v, const w_addr_t & a) {
+		for (auto it = v.begin(); it != v.end(); ++it) {
+			if (it->addr.sin_addr.s_addr == a.addr.sin_addr.s_addr) {
+				v.erase(it);
+				return;
+			}
 		}
 	}
+
+	void whale_server::set_up_peer_events(peer_t * p, el_socket_t fd) {
+		/* connected */
+		this->timers.cancel(&p->reconnect_timer);
+
+		register_peer_event(p, fd);
+	}
+
+	/*
+	* (re)register @p's connection @fd with the reactor. E_WRITE is only
+	* asked for while there is something to write, otherwise an idle
+	* socket would report writable on every reactor iteration.
+	*/
+	void whale_server::register_peer_event(peer_t * p, el_socket_t fd) {
+		short flags = E_READ;
+
+		/* sends through the ring don't wait for writability */
+		p->want_write = !uring_engine() &&
+		                (this->edge_triggered || has_output(p));
+
+		if (p->want_write)
+			flags |= E_WRITE;
+#ifdef E_EDGE
+		if (this->edge_triggered)
+			flags |= E_EDGE;
+#endif
+		remove_event_if_in_reactor(&p->e);
+
+		event_set(&p->e, fd, flags, peer_callback, p);
+
+		if (reactor_add_event(&this->r, &p->e) == -1)
+			log_error("failed to reactor_add_event for %s, fd[%d]: %s",
+			          p->addr.name.c_str(), fd, ::strerror(errno));
+	}
+
+	/*
+	* toggle E_WRITE when @p's queues turned empty or non-empty.
+	*/
+	void whale_server::update_write_interest(peer_t * p) {
+		if (this->edge_triggered || uring_engine() ||
+		    !event_in_reactor(&p->e) ||
+		    p->want_write == has_output(p))
+			return;
+
+		register_peer_event(p, p->e.fd);
+	}
 	/*
 	* compare candidate's log to receiver's.
 	* Return: true if candidate's log is at least as up-to-date as receiver's, false otherwise.
@@ -320,80 +590,119 @@ namespace whale {
 	}
 
 	void whale_server::process_request_vote(peer_t * p, msg_sptr msg) {
-		static char dummy[50];
-
 		rv_uptr rv{make_request_vote_from_msg(*msg)};
 		bool    granted = false;
 
+		if (rv.get() == nullptr) {
+			log_error("malformed request vote message");
+			return;
+		}
+
+		/*
+		* a pre-vote changes nothing here. it would be granted if the
+		* candidate's term is newer, its log is at least as up-to-date
+		* and we wouldn't time out ourselves since our leader is alive.
+		*/
+		if (rv->pre_vote) {
+			granted = rv->term > this->meta->term() && !leader_alive() &&
+			          compare_log_to_local(rv->last_log_idx, rv->last_log_term);
+
+			request_vote_res_t res = {this->meta->term(), granted,
+			                          rv->rpc_id, true};
+
+			queue_control(p, msg_sptr(make_msg_from_request_vote_res(res)));
+			handle_write_to_peer(p);
+			return;
+		}
+
+		/*
+		* a leader may serve reads off its lease till our election timeout,
+		* nobody else gets elected meanwhile unless it handed over.
+		*/
+		if (this->read_lease && leader_alive() && !rv->transfer) {
+			queue_control(p, msg_sptr(make_msg_from_request_vote_res({
+			                             this->meta->term(), false,
+			                             rv->rpc_id, false})));
+			handle_write_to_peer(p);
+			return;
+		}
+
+		/* a newer term forgets whom we voted for in the old one */
+		if (rv->term > this->meta->term())
+			turn_into_follower(rv->term);
+
 		/*
 		* grant if all of following conditions are true:
 		*     1. candidate's term >= currentTerm
 		*     2. votedFor is null(haven't voted for anyone) or the candidate in question.
 		*     3. candidate's log is at least as up-to-date as receiver's.
 		*/
-		if (rv->term >= get_fmapped()->current_term &&
-			(!::memcmp(&get_fmapped()->voted_for, dummy,
-		               sizeof(struct sockaddr_in)) || 
-			 !::memcmp(&get_fmapped()->voted_for, &rv->candidate_id.addr,
-			           sizeof(struct sockaddr_in))) &&
+		if (rv->term >= this->meta->term() &&
+			(this->meta->voted_for().sin_addr.s_addr == 0 ||
+			 this->meta->voted_for().sin_addr.s_addr ==
+			 p->addr.addr.sin_addr.s_addr) &&
 			compare_log_to_local(rv->last_log_idx, rv->last_log_term)) {
 
-			::memcpy(&get_fmapped()->voted_for, &p->addr.addr,
-			         sizeof(struct sockaddr_in));
-			get_fmapped()->current_term = rv->term;
-			this->map->sync();
+			this->meta->set_vote(p->addr.addr);
 			granted = true;
 
 			/* reset election timeer event */
 			reset_elec_timeout_event();
 		}
 
+		/* the new term and the vote hit the disk together, before the reply */
+		if (this->meta->sync() != WHALE_GOOD)
+			return;
+
 		/*
 		* make request vote result message accordingly.
 		*/
-		msg_q_elt elt{0, 0};
-		elt.msg = msg_sptr(make_msg_from_request_vote_res({
-				                     get_fmapped()->current_term, granted}));
-
-		p->write_queue.push(elt);
+		queue_control(p, msg_sptr(make_msg_from_request_vote_res({
+				                     this->meta->term(), granted,
+				                     rv->rpc_id, false})));
 
 		handle_write_to_peer(p);
 	}
 
+	/*
+	* heartbeats overtake queued entries, so they point at what the peer
+	* is known to have rather than at the end of our log. a heartbeat
+	* arriving ahead of the entries then still passes the consistency
+	* check.
+	*/
 	void whale_server::send_heartbeat() {
 		append_entries_t a;
-		a.term = get_fmapped()->current_term;
+
+		/* each heartbeat is a read round */
+		++this->read_round;
+
+		a.term = this->meta->term();
 		::memcpy(&a.leader_id.addr, &this->self.addr, sizeof(struct sockaddr_in));
-		a.prev_log_idx = this->log->get_last_log().index;
-		a.prev_log_term = this->log->get_last_log().term;
 		a.leader_commit = this->commit_index;
 		a.heartbeat = true;
 
-		/* make a generic message out of append entries struct */
-		msg_sptr p = msg_sptr(make_msg_from_append_entries(a));
-
 		for (auto & it : this->servers) {
 			if (!it.second.connected) continue;
-			it.second.write_queue.push({0, 0, p});
+
+			log_entry_it prev = this->log->find_by_idx(it.second.match_idx);
+
+			if (prev == this->log->get_entries().end())
+				prev = this->log->get_entries().end() - 1;
+
+			a.prev_log_idx = prev->index;
+			a.prev_log_term = prev->term;
+			a.rpc_id = ++this->rpc_seq;
+			track_rpc(&it.second, a.rpc_id, MESSAGE_APPEND_ENTRIES, true);
+
+			/* make a generic message out of append entries struct */
+			queue_control(&it.second, msg_sptr(make_msg_from_append_entries(a)));
 			handle_write_to_peer(&it.second);
 		}
 	}
 
 	void whale_server::reset_heartbeat_timer() {
-		/* 
-		*  connect is in progress or peer is not online,
-		*  setup a timer to reconnect after a period of time.
-		*/
-		struct event * hb_timeout_e = &this->hb_timeout_event;
-
-		remove_event_if_in_reactor(hb_timeout_e);
-
-		event_set(hb_timeout_e, WHLAE_HEARTBEAT_TIMEOUT, E_TIMEOUT,
-		          hearbeat_callback, this);
-
-		if (reactor_add_event(&this->r, hb_timeout_e) == -1)
-		    log_error("failed to reactor_add_event for"
-		              " hearbeat timeer event: %s", ::strerror(errno));
+		this->timers.add(&this->hb_timer, WHLAE_HEARTBEAT_TIMEOUT,
+		                 hearbeat_callback, this);
 	}
 	/*
 	* sends initial append entires(heartbeat) to servers to claim to 
@@ -402,183 +711,339 @@ namespace whale {
 	*/
 	void whale_server::claim_leadership() {
 		this->state = LEADER;
+		fail_forwarding();
+		this->cur_leader = nullptr;
+
+		/* replication restarts right after our last entry */
+		for (auto & it : this->servers) {
+			it.second.next_idx = this->log->get_last_log().index + 1;
+			it.second.match_idx = 0;
+			it.second.probing = true;
+			it.second.lease_ack = 0;
+			forget_append_entries(&it.second);
+		}
+		/* a lease is earned anew in every term */
+		this->lease_from = 0;
+
+		/*
+		* entries of earlier terms commit only along with one of ours,
+		* membership changes and reads wait for that too.
+		*/
+		this->noop_idx = this->log->get_last_log().index + 1;
+		this->log->get_entries().push_back({(int32_t)this->noop_idx,
+		                                    (int32_t)this->meta->term(),
+		                                    LOG_NOOP_DATA});
+
 		/* remove election timer */
-		remove_event_if_in_reactor(&this->elec_timeout_event);
+		this->timers.cancel(&this->elec_timer);
 		send_heartbeat();
+		reset_heartbeat_timer();
+		reset_quorum_timer();
+		send_append_entries();
 	}
 
 	void whale_server::turn_into_follower(w_int_t term) {
-		get_fmapped()->current_term = term;
+		/* made durable by the caller, along with whatever else changed */
+		if (term > this->meta->term())
+			this->meta->set_term(term);
 		this->state = FOLLOWER;
 		this->vote_count = 0;
+		end_transfer();
+		/* followers asking for read indexes go elsewhere */
+		answer_read_indexes();
+		/* and so do clients whose reads we were confirming */
+		redirect_leader_reads();
+		/* followers redirect their own clients when we stop answering */
+		this->forwarded.clear();
+		/* followers don't send heartbeats */
+		this->timers.cancel(&this->hb_timer);
+		this->timers.cancel(&this->quorum_timer);
 		/* start an election timer */
 		reset_elec_timeout_event();
-		this->map->sync();
 	}
 
 	void whale_server::process_request_vote_res(peer_t * p, msg_sptr msg) {
 		rvr_uptr rvr{make_request_vote_res_from_msg(*msg)};
-		/* no use of request for request_vote_res */
-		p->request_queue.pop();
+		rpc_t    rpc;
+
+		if (rvr.get() == nullptr) {
+			log_error("malformed request vote result message");
+			return;
+		}
+
+		if (rvr->term > this->meta->term()) {
+			/* a leader is elceted, turn into a follower. */
+			turn_into_follower(rvr->term);
+			this->meta->sync();
+			return;
+		}
+
+		/* timed out already or not ours */
+		if (!complete_rpc(p, rvr->rpc_id, &rpc) ||
+		    rpc.type != (rvr->pre_vote ? MESSAGE_PRE_VOTE : MESSAGE_REQUEST_VOTE))
+			return;
+
+		if (rvr->pre_vote) {
+			if (this->state != PRE_CANDIDATE ||
+			    rpc.term != this->meta->term() || !rvr->vote_granted)
+				return;
+
+			/* we could win, now go for it */
+			if (p->member && !p->learner && ++this->vote_count > voters() / 2)
+				turn_into_candidate();
+			return;
+		}
 
 		/*
-		* ignore if current role is not candidate or 
-		* we are in a later term (we've become a leader
+		* ignore if current role is not candidate or the vote was
+		* asked for in an earlier term (we've become a leader
 		* or a follower, or we've had a collision and 
 		* started a new term).
 		*/
 		if (this->state != CANDIDATE ||
-			rvr->term < get_fmapped()->current_term) {
+			rpc.term != this->meta->term()) {
 			return;
 		}
 
-		if (rvr->vote_granted) {
-			if (++this->vote_count > (this->peers.size() + 1) / 2) {
+		/* only voters of the active configuration elect */
+		if (rvr->vote_granted && p->member && !p->learner) {
+			if (++this->vote_count > voters() / 2) {
 				/* whoo, got majority of votes! */
 				claim_leadership();
 				this->vote_count = 0;
 			}
-		} else if (rvr->term >= get_fmapped()->current_term) {
-			/* a leader is elceted, turn into a follower. */
-			turn_into_follower(rvr->term);
 		}
 
 	}
 
 	void whale_server::process_append_entries(peer_t * p, msg_sptr msg) {
-		ae_uptr ae{make_append_entries_from_msg(*msg)};
-		bool    success = false;
+		ae_uptr              ae{make_append_entries_from_msg(*msg)};
+		append_entries_res_t res = {0, false, false, 0};
+		log_entry_it         it;
+
+		if (ae.get() == nullptr) {
+			log_error("malformed append entries message");
+			return;
+		}
+
+		res.heartbeat = ae->heartbeat;
+		res.rpc_id = ae->rpc_id;
 
 		/*
 		* reply false if term < currentTerm
 		*/
-		if (ae->term < get_fmapped()->current_term) {
+		if (ae->term < this->meta->term())
 			goto send_message;
-		} else if(ae->term > get_fmapped()->current_term) {
-			/* new leader, update self */
-			get_fmapped()->current_term = ae->term;
-			this->map->sync();
-		}
 
-		if (ae->entries.empty()) { /* heartbeat message */
-			this->cur_leader = p;
-			success = true;
-			goto send_message;
-		} else { /* normal appending message */
-			/* log consistency Check: 
-			*  replay false if log doesn’t contain an entry 
-			*  at prevLogIndex whose term matches prevLogTerm.
-			*/
-			log_entry_it it = this->log->find_by_idx(ae->prev_log_idx);
+		/* a legitimate leader of this term, follow it */
+		if (ae->term > this->meta->term() || this->state != FOLLOWER)
+			turn_into_follower(ae->term);
+		else
+			reset_elec_timeout_event();
+
+		/* commands forwarded to an old leader won't be answered */
+		if (this->cur_leader != p)
+			fail_forwarding();
+
+		this->cur_leader = p;
+		this->leader_contact = this->timers.now();
+
+		/* commands held back during a handover go to the new leader */
+		if (this->clients_parked)
+			resume_parked_clients();
+
+		/* log consistency Check: 
+		*  replay false if log doesn’t contain an entry 
+		*  at prevLogIndex whose term matches prevLogTerm.
+		*/
+		it = this->log->find_by_idx(ae->prev_log_idx);
 
-			if (it == this->log->get_entries().end() ||
-			    it->term != ae->prev_log_term)
-				goto send_message;
+		if (it == this->log->get_entries().end() ||
+		    it->term != ae->prev_log_term) {
+			/* hint the leader where our log ends */
+			res.match_idx = std::min(ae->prev_log_idx - 1,
+			                         (w_int_t)this->log->get_last_log().index);
+			goto send_message;
 		}
 
 		/*
 		* log consistency check passed, extraneous entries deletion:
 		* If an existing entry conflicts with a new one (same index
 		* but different terms), delete the existing entry and all that
-        * follow it.
+        * follow it. Entries we already have are not appended twice.
 		*/
-		for (auto & new_entry : ae->entries ) {
-			log_entry_it it = this->log->find_by_idx(new_entry.index);
+		for (size_t i = 0; i < ae->entries.size(); ++i) {
+			log_entry_it eit = this->log->find_by_idx(ae->entries[i].index);
+			bool         reload;
 
-			if (it == this->log->get_entries().end() ||
-				it->term != new_entry.term) {
-				this->log->chop(it);
-				break;
-			}
+			if (eit != this->log->get_entries().end() &&
+				eit->term == ae->entries[i].term)
+				continue;
+
+			/* a configuration takes effect once in the log, and goes with it */
+			reload = eit != this->log->get_entries().end() &&
+			         eit->index <= this->conf_idx;
+
+			if (eit != this->log->get_entries().end())
+				this->log->chop(eit);
+
+			for (size_t j = i; j < ae->entries.size(); ++j)
+				reload = reload || LOG_DATA_IS_CONF(ae->entries[j].data);
+
+			this->log->append(std::vector<log_entry_t>(ae->entries.begin() + i,
+			                                           ae->entries.end()));
+
+			if (reload)
+				load_members();
+			break;
 		}
 
-		this->log->append(ae->entries);
-		success = true;
+		res.success = true;
+		res.match_idx = ae->prev_log_idx + ae->entries.size();
 
-		if (ae->leader_commit > this->commit_index)
-			this->commit_index = std::min(ae->leader_commit,
-			                              (w_int_t)ae->entries.back().index);
+		if (ae->leader_commit > this->commit_index) {
+			this->commit_index = std::min(ae->leader_commit, res.match_idx);
+			apply_log();
+			reply_reads();
+		}
 	send_message:
 
+		/* a term we moved on to must be durable before we answer in it */
+		if (this->meta->sync() != WHALE_GOOD)
+			return;
+
 		/*
 		* make append entries result message accordingly.
 		*/
-		msg_q_elt elt{0, 0};
-		elt.msg = msg_sptr(make_msg_from_append_entries_res({
-				                     get_fmapped()->current_term, success}));
+		res.term = this->meta->term();
 
-		p->write_queue.push(elt);
+		queue_control(p, msg_sptr(make_msg_from_append_entries_res(res)));
 
 		handle_write_to_peer(p);
 	}
 
-	void whale_server::push_append_entries(peer_t * p, size_t start) {
+	/*
+	* queue an AppendEntries to @p carrying entries from index @start on,
+	* at most WHALE_AE_MAX_BYTES of them but at least one.
+	* Return: number of entries queued.
+	*/
+	size_t whale_server::push_append_entries(peer_t * p, size_t start) {
 		append_entries_t         a;
-		std::vector<log_entry_t> entries = this->log->get_entries();
-		log_entry_t             &e = entries[entries.size() - 2];
-		
-		a.prev_log_idx = e.index;
-		a.prev_log_term = e.term;
-		a.term = get_fmapped()->current_term;
+		std::vector<log_entry_t> &entries = this->log->get_entries();
+		log_entry_it             prev = this->log->find_by_idx(start - 1);
+		log_entry_it             end;
+		size_t                   bytes = 0;
+
+		if (prev == entries.end() || prev + 1 == entries.end())
+			return 0;
+
+		for (end = prev + 1; end != entries.end(); ++end) {
+			bytes += LOG_ENTRY_LEN(*end);
+			if (bytes > WHALE_AE_MAX_BYTES && end != prev + 1)
+				break;
+		}
+
+		a.prev_log_idx = prev->index;
+		a.prev_log_term = prev->term;
+		a.term = this->meta->term();
 		a.leader_commit = this->commit_index;
 		::memcpy(&a.leader_id.addr, &this->self.addr, sizeof(struct sockaddr_in));
 		a.heartbeat = false;
+		a.entries.assign(prev + 1, end);
+		a.rpc_id = ++this->rpc_seq;
+		track_rpc(p, a.rpc_id, MESSAGE_APPEND_ENTRIES, false,
+		          a.entries.back().index);
 
-		for (size_t i = start; i < entries.size(); ++i ) {
-			a.entries.push_back(entries[i]);
-		}
-
-		/*
-		* make request vote result message accordingly.
-		*/
-		msg_q_elt elt{0, 0};
-		elt.msg = msg_sptr{make_msg_from_append_entries(a)};
+		queue_bulk(p, msg_sptr{make_msg_from_append_entries(a)});
 
-		p->write_queue.push(elt);
+		return a.entries.size();
 	}
 
-	/**
-	* If there exists an N such that N > commitIndex, a majority
-	* of matchIndex[i] ≥ N, and log[N].term == currentTerm:
-	* set commitIndex = N.
+	/*
+	* send @p what it misses from our log, as far as flow control lets us.
+	* a probing peer gets one AppendEntries at a time, otherwise they are
+	* pipelined with @next_idx moving ahead optimistically.
 	*/
-	void whale_server::leader_adjust_commit_index() {
-		std::vector<log_entry_t> &entries = this->log->get_entries();
-		w_int_t                   min_n = this->log->get_last_log().index;
-		w_int_t                   max_n = -1;
+	void whale_server::replicate_to(peer_t * p) {
+		w_int_t  last = this->log->get_last_log().index;
+		w_uint_t window = p->probing ? 1 : this->peer_max_inflight;
+		size_t   n;
 
-		for (auto & it : this->servers) {
-			if (it.second.match_idx > this->commit_index) {
-				log_entry_it eit = this->log->find_by_idx(it.second.match_idx);
+		if (!p->connected)
+			return;
 
-				if (eit != entries.end() &&
-				    eit->term == get_fmapped()->current_term) {
-					min_n = std::min(it.second.match_idx, min_n);
-					max_n = std::max(it.second.match_idx, max_n);
-				}
-			}
+		while (p->next_idx <= last && p->inflight_ae < window &&
+		       p->queued_bytes < this->peer_max_bytes) {
+			if ((n = push_append_entries(p, p->next_idx)) == 0)
+				break;
+
+			if (p->probing)
+				break;
+
+			p->next_idx += n;
 		}
 
-		for (w_int_t i = max_n; i >= min_n; --i) {
-			w_uint_t maj = 0;
+		handle_write_to_peer(p);
+	}
+
+	/**
+	* If there exists an N such that N > commitIndex, a majority
+	* of matchIndex[i] ≥ N, and log[N].term == currentTerm:
+	* set commitIndex = N.
+	*/
+	void whale_server::leader_adjust_commit_index() {
+		for (w_int_t n = this->log->get_last_log().index;
+		     n > this->commit_index; --n) {
+			log_entry_it eit = this->log->find_by_idx(n);
+
+			/* entries before this one are from older terms too */
+			if (eit == this->log->get_entries().end() ||
+			    eit->term != this->meta->term())
+				break;
+
+			/* voters of the active configuration decide, learners don't */
+			w_uint_t maj = self_voter() ? 1 : 0;
 			for (auto & it : this->servers) {
-				if (it.second.match_idx > i) {
+				if (it.second.member && !it.second.learner &&
+				    it.second.match_idx >= n) {
 					++maj;
 				}
 			}
 
-			if (maj + 1 > (this->servers.size() + 1) / 2) {
-				this->commit_index = i;
+			if (maj > voters() / 2) {
+				this->commit_index = n;
 				break;
 			}
 		}
 
+		/* the last change is in, go on with the next one */
+		schedule_membership_change();
 	}
 
 	void whale_server::apply_log() {
+		w_int_t applied = this->last_applied;
+
 		if (this->commit_index > this->last_applied) {
-			this->last_applied = this->commit_index;
 			this->log->commit_until(this->commit_index);
+
+			/* with the write in flight, entries count once they are on disk */
+			if (this->log->async())
+				this->last_applied = std::max(this->last_applied,
+				                              std::min(this->commit_index,
+				                                       this->log->durable_index()));
+			else
+				this->last_applied = this->commit_index;
+		}
+
+		/* feed what got applied to the state machine */
+		if (this->last_applied > applied) {
+			std::vector<log_entry_t> & entries = this->log->get_entries();
+
+			for (log_entry_it it = this->log->find_by_idx(applied + 1);
+			     it != entries.end() && it->index <= this->last_applied; ++it) {
+				if (!LOG_DATA_INTERNAL(it->data))
+					this->kv.apply(it->data);
+			}
 		}
 	}
 
@@ -586,20 +1051,434 @@ namespace whale {
 	* notify client that a command message has been 
 	* succesfully processed by the system.
 	*/
-	void whale_server::reply_success_to_client(peer_t * client) {
-		cmd_request_res_t cmdr;
+	void whale_server::reply_success_to_client(peer_t * client, w_int_t index) {
+		cmd_request_res_t cmdr = {};
+		cmdr.res = true;
+		cmdr.index = index;
+
+		send_to_client(client, cmdr);
+	}
+
+	/*
+	* a plain refusal, no leader to try instead.
+	*/
+	void whale_server::reply_failure_to_client(peer_t * client) {
+		cmd_request_res_t cmdr = {};
+		cmdr.res = false;
+
+		send_to_client(client, cmdr);
+	}
+
+	void whale_server::reply_read_to_client(peer_t * client) {
+		cmd_request_res_t cmdr = {};
+
 		cmdr.res = true;
+		cmdr.index = this->last_applied;
+		if (!this->kv.query(client->cur_cmd->cmd, cmdr.value))
+			log_error("unknown query \"%s\"", client->cur_cmd->cmd.c_str());
+
+		send_to_client(client, cmdr);
+	}
 
-		message_queue_elt_s elt{0, 0};
-		elt.msg = msg_sptr{make_msg_from_cmd_request_res(cmdr)};
+	/*
+	* ReadIndex: the read sees everything committed when it came in, once
+	* a heartbeat round started after that confirmed we are still the
+	* leader. Reads queued meanwhile share the round, no log entry and
+	* no disk write involved.
+	*/
+	void whale_server::start_read(peer_t * client) {
+		client->cur_cmd->index = std::max(this->commit_index, this->noop_idx);
+		client->cur_cmd->lead_term = this->meta->term();
 
-		client->write_queue.push(elt);
+		/* nobody else can be leader yet, no round trip needed */
+		if (lease_valid()) {
+			client->cur_cmd->term = this->read_confirmed;
+			arm_client_deadline(client);
 
-		this->handle_write_to_peer(client);
+			if (serve_read(client) && !client->c_queue.empty())
+				process_cmd_request(client);
+			return;
+		}
+
+		client->cur_cmd->term = this->read_round + 1;
+		this->read_wanted = this->read_round + 1;
+		arm_client_deadline(client);
+
+		/* no round in flight, start one now rather than at the next heartbeat */
+		if (this->read_confirmed == this->read_round)
+			send_heartbeat();
+
+		confirm_reads();
+	}
+
+	/*
+	* move @read_confirmed up to the latest round a majority answered,
+	* then answer the reads it covers.
+	*/
+	void whale_server::confirm_reads() {
+		std::vector<uint64_t> acks;
+		uint64_t              confirmed;
+
+		for (auto & it : this->servers) {
+			if (it.second.member && !it.second.learner)
+				acks.push_back(it.second.read_ack);
+		}
+
+		if (!majority_value(acks, this->read_round, confirmed) ||
+		    confirmed <= this->read_confirmed)
+			return;
+
+		this->read_confirmed = confirmed;
+		answer_read_indexes();
+		reply_clients();
+
+		/* reads that came in during the round need another one */
+		if (this->read_wanted > this->read_round &&
+		    this->read_confirmed == this->read_round)
+			send_heartbeat();
+	}
+
+	/*
+	* a session read: answered once we applied up to the client's token,
+	* in any state. A replica that doesn't get there in time redirects
+	* through the client deadline like any other command.
+	*/
+	void whale_server::session_read(peer_t * client) {
+		client->cur_cmd->index = client->cur_cmd->min_index;
+		/* needs no confirmation, leader or not */
+		client->cur_cmd->term = 0;
+
+		if (serve_read(client)) {
+			if (!client->c_queue.empty())
+				process_cmd_request(client);
+			return;
+		}
+
+		arm_client_deadline(client);
+	}
+
+	/*
+	* a read on a follower: ask the leader for its read index, together
+	* with the other reads of this reactor iteration.
+	*/
+	void whale_server::follower_read(peer_t * client) {
+		client->cur_cmd->index = WHALE_READ_PENDING;
+		arm_client_deadline(client);
+
+		if (this->read_index_open != 0) {
+			client->cur_cmd->term = this->read_index_open;
+			return;
+		}
+
+		this->read_index_open = ++this->read_index_seq;
+		client->cur_cmd->term = this->read_index_open;
+
+		event_set(&this->read_index_event, 0, E_TIMEOUT,
+		          read_index_callback, this);
+
+		if (reactor_add_event(&this->r, &this->read_index_event) == -1) {
+			log_error("failed to reactor_add_event for"
+			          " read index event: %s", ::strerror(errno));
+			flush_read_index();
+		}
+	}
+
+	void whale_server::flush_read_index() {
+		read_index_t ri;
+
+		remove_event_if_in_reactor(&this->read_index_event);
+
+		if (this->read_index_open == 0)
+			return;
+
+		ri.id = this->read_index_open;
+		this->read_index_open = 0;
+
+		if (!leader_reachable()) {
+			resolve_follower_reads(ri.id, false, 0);
+			return;
+		}
+
+		queue_control(this->cur_leader, msg_sptr{make_msg_from_read_index(ri)});
+		handle_write_to_peer(this->cur_leader);
+	}
+
+	/*
+	* the leader answered read index request @id: the reads under it are
+	* served once we applied up to @index, or redirected if not @ok.
+	*/
+	void whale_server::resolve_follower_reads(w_uint_t id, bool ok,
+	                                          w_int_t index) {
+		for (auto & it : this->clients) {
+			peer_t * client = &it.second;
+
+			if (client->cur_cmd.get() == nullptr || !client->cur_cmd->read ||
+			    client->cur_cmd->index != WHALE_READ_PENDING ||
+			    (w_uint_t)client->cur_cmd->term != id)
+				continue;
+
+			if (ok) {
+				client->cur_cmd->index = index;
+				client->cur_cmd->term = 0;
+				continue;
+			}
+
+			finish_client_cmd(client);
+			reply_redirect_to_client(client);
+
+			if (!client->c_queue.empty())
+				process_cmd_request(client);
+		}
+
+		if (ok)
+			reply_reads();
+	}
+
+	/*
+	* answer @client's read if it is confirmed and applied.
+	* a leader's read is confirmed by a read round of the term it came
+	* in, a follower's by the leader handing out its read index, which
+	* leaves @term 0. Session reads start out at 0, their token is all
+	* they wait for.
+	* Return: true if answered.
+	*/
+	bool whale_server::serve_read(peer_t * client) {
+		cmd_sptr & c = client->cur_cmd;
+		bool       confirmed;
+
+		if (c->index == WHALE_READ_PENDING || c->index > this->last_applied)
+			return false;
+
+		if (c->lead_term != 0)
+			confirmed = this->state == LEADER &&
+			            c->lead_term == this->meta->term() &&
+			            (w_uint_t)c->term <= this->read_confirmed;
+		else
+			confirmed = c->term == 0;
+
+		if (!confirmed)
+			return false;
+
+		reply_read_to_client(client);
+		finish_client_cmd(client);
+		return true;
+	}
+
+	/*
+	* we stepped down, the rounds confirming our own reads won't
+	* complete. Send their clients to whoever leads now.
+	*/
+	void whale_server::redirect_leader_reads() {
+		for (auto & it : this->clients) {
+			peer_t * client = &it.second;
+
+			if (client->cur_cmd.get() == nullptr || !client->cur_cmd->read ||
+			    client->cur_cmd->lead_term == 0)
+				continue;
+
+			finish_client_cmd(client);
+			reply_redirect_to_client(client);
+
+			if (!client->c_queue.empty())
+				process_cmd_request(client);
+		}
+	}
+
+	void whale_server::reply_reads() {
+		for (auto & it : this->clients) {
+			if (it.second.cur_cmd.use_count() && it.second.cur_cmd->read &&
+			    serve_read(&it.second) && !it.second.c_queue.empty())
+				process_cmd_request(&it.second);
+		}
+	}
+
+	/*
+	* leader side of follower reads, the read index is handed out like
+	* for our own reads: at once under a lease, otherwise once a read
+	* round confirmed it.
+	*/
+	void whale_server::process_read_index(peer_t * p, msg_sptr msg) {
+		ri_uptr          ri{make_read_index_from_msg(*msg)};
+		read_index_res_t res;
+
+		if (ri.get() == nullptr) {
+			log_error("malformed read index message");
+			return;
+		}
+
+		res.id = ri->id;
+		res.index = std::max(this->commit_index, this->noop_idx);
+		res.ok = false;
+
+		if (this->state == LEADER && this->transferee == nullptr &&
+		    !lease_valid()) {
+			this->remote_reads.push_back({p, ri->id, res.index,
+			                              this->read_round + 1});
+			this->read_wanted = this->read_round + 1;
+
+			if (this->read_confirmed == this->read_round)
+				send_heartbeat();
+
+			confirm_reads();
+			return;
+		}
+
+		res.ok = this->state == LEADER && this->transferee == nullptr;
+
+		queue_control(p, msg_sptr{make_msg_from_read_index_res(res)});
+		handle_write_to_peer(p);
+	}
+
+	/*
+	* answer follower read index requests confirmed by now, all of them
+	* with false if we are not the leader any more.
+	*/
+	void whale_server::answer_read_indexes() {
+		while (!this->remote_reads.empty()) {
+			remote_read_t & r = this->remote_reads.front();
+			bool            ok = this->state == LEADER;
+
+			if (ok && r.round > this->read_confirmed)
+				break;
+
+			if (r.from->connected) {
+				queue_control(r.from, msg_sptr{make_msg_from_read_index_res(
+				                                   {r.id, r.index, ok})});
+				handle_write_to_peer(r.from);
+			}
+
+			this->remote_reads.pop_front();
+		}
+	}
+
+	void whale_server::process_read_index_res(peer_t * p, msg_sptr msg) {
+		rir_uptr rir{make_read_index_res_from_msg(*msg)};
+
+		if (rir.get() == nullptr) {
+			log_error("malformed read index result message");
+			return;
+		}
+
+		resolve_follower_reads(rir->id, rir->ok, rir->index);
+	}
+
+	/*
+	* Return: the send time of the latest request a majority of voters,
+	*         us included, answered in our term. 0 if there is none.
+	*/
+	uint64_t whale_server::quorum_contact() {
+		std::vector<uint64_t> acks;
+		uint64_t              from;
+
+		for (auto & it : this->servers) {
+			if (it.second.member && !it.second.learner)
+				acks.push_back(it.second.lease_ack);
+		}
+
+		return majority_value(acks, this->timers.now(), from) ? from : 0;
+	}
+
+	void whale_server::update_lease() {
+		uint64_t from = quorum_contact();
+
+		if (from > this->lease_from)
+			this->lease_from = from;
+	}
+
+	void whale_server::reset_quorum_timer() {
+		if (!this->check_quorum)
+			return;
+
+		this->timers.add(&this->quorum_timer, WHALE_MAX_ELEC_TIMEOUT,
+		                 quorum_check_callback, this);
+	}
+
+	/*
+	* step down if no majority answered anything we sent within the
+	* last election timeout: it may have elected someone else already,
+	* and what we append can't commit anyway. Commands we hold are
+	* redirected instead of waiting for their deadline, new ones are
+	* redirected as we are no longer the leader.
+	*/
+	void whale_server::check_leader_quorum() {
+		uint64_t now = this->timers.now();
+
+		if (this->state != LEADER)
+			return;
+
+		if (quorum_contact() + WHALE_MAX_ELEC_TIMEOUT > now) {
+			reset_quorum_timer();
+			return;
+		}
+
+		log_error("lost contact with a majority in term %ld, stepping down",
+		          (long)this->meta->term());
+
+		turn_into_follower(this->meta->term());
+
+		for (auto & it : this->clients) {
+			peer_t * client = &it.second;
+
+			/* session reads can still be answered by a follower */
+			if (client->cur_cmd.get() == nullptr ||
+			    (client->cur_cmd->read &&
+			     client->cur_cmd->min_index != CMD_LINEARIZABLE))
+				continue;
+
+			finish_client_cmd(client);
+			reply_redirect_to_client(client);
+
+			if (!client->c_queue.empty())
+				process_cmd_request(client);
+		}
+
+		/* parked while handing leadership over */
+		if (this->clients_parked)
+			resume_parked_clients();
+	}
+
+	/*
+	* the lease is ours while no follower that answered us would vote
+	* before its election timeout, less what the clocks may drift meanwhile.
+	* a handover ends it early since the transferee is voted for at once.
+	*/
+	bool whale_server::lease_valid() {
+		if (!this->read_lease || this->state != LEADER ||
+		    this->transferee != nullptr || this->lease_from == 0)
+			return false;
+
+		return monotonic_ms() < this->lease_from + WHALE_MIN_ELEC_TIMEOUT -
+		                        this->lease_drift;
+	}
+
+	/*
+	* @acks holds a value for every voter but us, we count as having
+	* reached @self.
+	* Return: false if there is no majority, otherwise true with the
+	*         highest value a majority reached in @out.
+	*/
+	bool whale_server::majority_value(std::vector<uint64_t> & acks,
+	                                  uint64_t self, uint64_t & out) {
+		w_uint_t need = voters() / 2 + 1;
+
+		if (self_voter())
+			--need;
+
+		if (need == 0) {
+			out = self;
+			return true;
+		}
+
+		if (need > acks.size())
+			return false;
+
+		std::sort(acks.begin(), acks.end(), std::greater<uint64_t>());
+		out = std::min(acks[need - 1], self);
+		return true;
 	}
 
 	void whale_server::reply_redirect_to_client(peer_t * client) {
-		cmd_request_res_t cmdr;
+		cmd_request_res_t cmdr = {};
 		cmdr.res = false;
 
 		if (this->cur_leader != nullptr) {
@@ -608,351 +1487,1809 @@ namespace whale {
 				     sizeof(struct sockaddr_in));
 		}
 
-		message_queue_elt_s elt{0, 0};
-		elt.msg = msg_sptr{make_msg_from_cmd_request_res(cmdr)};
+		send_to_client(client, cmdr);
+	}
+
+	/*
+	* a worker serving @client encodes and writes the reply itself.
+	*/
+	void whale_server::send_to_client(peer_t * client,
+	                                  const cmd_request_res_t & cmdr) {
+		if (client->worker != -1) {
+			this->workers[client->worker]->post({WORKER_CMD_REPLY,
+			                                     client->conn_id, -1, cmdr});
+			return;
+		}
 
-		client->write_queue.push(elt);
+		queue_bulk(client, msg_sptr{make_msg_from_cmd_request_res(cmdr)});
 
 		this->handle_write_to_peer(client);
 	}
 
+	void whale_server::arm_client_deadline(peer_t * client) {
+		if (this->client_timeout > 0)
+			this->timers.add(&client->deadline, this->client_timeout,
+			                 client_deadline_callback, client);
+	}
+
+	void whale_server::finish_client_cmd(peer_t * client) {
+		client->cur_cmd.reset();
+		this->timers.cancel(&client->deadline);
+	}
+
+	/*
+	* @client's command got no answer within client_timeout. It may still
+	* commit later, the client only learns it didn't hear back in time and
+	* is pointed at whoever leads now, us included.
+	*/
+	void whale_server::client_timed_out(peer_t * client) {
+		cmd_request_res_t cmdr = {};
+
+		if (client->cur_cmd.get() == nullptr)
+			return;
+
+		finish_client_cmd(client);
+
+		cmdr.res = false;
+		if (this->state == LEADER)
+			::memcpy(&cmdr.leader.addr, &this->self.addr,
+			         sizeof(struct sockaddr_in));
+		else if (this->cur_leader != nullptr)
+			::memcpy(&cmdr.leader.addr, &this->cur_leader->addr.addr,
+			         sizeof(struct sockaddr_in));
+
+		send_to_client(client, cmdr);
+
+		if (!client->c_queue.empty())
+			process_cmd_request(client);
+	}
+
 	void whale_server::reply_clients() {
+		reply_forwarded();
+
 		for (auto & it : this->clients) {
+			if (it.second.cur_cmd.use_count() && it.second.cur_cmd->read) {
+				if (serve_read(&it.second) && !it.second.c_queue.empty())
+					process_cmd_request(&it.second);
+				continue;
+			}
+
 			/* a command in process */
 			if (it.second.cur_cmd.use_count()) {
-				if (it.second.cur_cmd->term <= get_fmapped()->current_term &&
+				if (it.second.cur_cmd->term <= this->meta->term() &&
 					it.second.cur_cmd->index <= this->last_applied) {
-					reply_success_to_client(&it.second);
-					it.second.cur_cmd.reset();
+					reply_success_to_client(&it.second,
+					                        it.second.cur_cmd->index);
+					finish_client_cmd(&it.second);
+
+					/* move on to commands pipelined behind it */
+					if (!it.second.c_queue.empty())
+						process_cmd_request(&it.second);
 				}
 			}
 		}
 	}
 	void whale_server::process_append_entries_res(peer_t * p, msg_sptr msg) {
 		aer_uptr aes = aer_uptr{make_append_entries_res_from_msg(*msg)};
-		
-		if (this->state != LEADER || aes->heartbeat)
+		rpc_t    rpc;
+
+		if (aes.get() == nullptr) {
+			log_error("malformed append entries result message");
 			return;
+		}
 
-		if (aes->term > get_fmapped()->current_term) {
+		if (aes->term > this->meta->term()) {
 			/* a leader is reelceted, turn into a follower. */
 			turn_into_follower(aes->term);
-		} else if (aes->success) {
-			p->match_idx = p->next_idx++;
+			this->meta->sync();
+			return;
+		}
+
+		/* timed out, forgotten or not ours */
+		if (!complete_rpc(p, aes->rpc_id, &rpc) ||
+		    rpc.type != MESSAGE_APPEND_ENTRIES)
+			return;
+
+		if (this->state != LEADER || rpc.term != this->meta->term())
+			return;
+
+		if (!rpc.heartbeat)
+			--p->inflight_ae;
+
+		/* an answer in our term, we were the leader when it was sent */
+		if (rpc.sent_at > p->lease_ack) {
+			p->lease_ack = rpc.sent_at;
+			update_lease();
+		}
+
+		if (rpc.read_round > p->read_ack) {
+			p->read_ack = rpc.read_round;
+			confirm_reads();
+		}
+
+		if (aes->success) {
+			if (aes->match_idx > p->match_idx)
+				p->match_idx = aes->match_idx;
+			p->next_idx = std::max(p->next_idx, p->match_idx + 1);
+
+			/* the probe got through, pipeline from here on */
+			if (p->probing && !rpc.heartbeat)
+				p->probing = false;
+
+			/* a learner to be promoted may have caught up */
+			if (p->learner)
+				schedule_membership_change();
+
+			if (p == this->transferee && !this->timeout_now_sent &&
+			    p->match_idx == this->log->get_last_log().index)
+				send_timeout_now(p);
+
 			leader_adjust_commit_index();
 			apply_log();
 			reply_clients();
 		} else {
-			p->match_idx = (--p->next_idx - 1);
+			/*
+			* lost track of the follower's log, drop the optimistic
+			* next_idx and probe back, jumping straight to its end.
+			*/
+			if (!p->probing) {
+				p->probing = true;
+				/* replies to the rest of the pipeline don't matter now */
+				forget_append_entries(p);
+				p->next_idx = aes->match_idx + 1;
+			} else {
+				p->next_idx = std::min(p->next_idx - 1, aes->match_idx + 1);
+			}
+			p->next_idx = std::max((w_int_t)1, p->next_idx);
+		}
+
+		/* resend or move on, entries starting at p->next_idx */
+		replicate_to(p);
+	}
+
+	/*
+	* log how far behind every server is and how much is queued for it.
+	*/
+	void whale_server::dump_peer_stats() {
+		for (auto & it : this->servers) {
+			peer_t & p = it.second;
+
+			log_error("peer %s: %s queued %lu bytes in %lu frames, "
+			          "%u in flight%s, next %ld match %ld",
+			          w_addr_to_string(p.addr).c_str(),
+			          p.connected ? "up" : "down",
+			          (unsigned long)p.queued_bytes,
+			          (unsigned long)(p.write_queue.size() + p.ctrl_queue.size()),
+			          (unsigned)p.inflight_ae, p.probing ? " (probing)" : "",
+			          (long)p.next_idx, (long)p.match_idx);
+		}
+
+		this->timers.add(&this->stats_timer, this->peer_stats_interval,
+		                 peer_stats_callback, this);
+	}
+
+	void whale_server::send_append_entries() {
+		/**
+		* If last log index ≥ nextIndex for a follower: send
+		* AppendEntries RPC with log entries starting at nextIndex
+		*/
+		for (auto & it : this->servers)
+			replicate_to(&it.second);
+	}
+
+	void whale_server::process_cmd_request(peer_t * p) {
+		/* read-your-writes only, whoever has applied far enough answers */
+		if (!p->c_queue.empty() && p->c_queue.front()->read &&
+		    p->c_queue.front()->min_index != CMD_LINEARIZABLE) {
+			p->cur_cmd = p->c_queue.front();
+			p->c_queue.pop();
+			session_read(p);
+			return;
+		}
+
+		/* followers serve reads themselves, the leader only tells up to where */
+		if (this->state != LEADER && this->follower_reads &&
+		    leader_reachable() && !p->c_queue.empty() &&
+		    p->c_queue.front()->read) {
+			p->cur_cmd = p->c_queue.front();
+			p->c_queue.pop();
+			follower_read(p);
+			return;
+		}
+
+		/*
+		* configuration and no-op entries are ours only. no leader
+		* takes them either, a redirect would only bring them back.
+		*/
+		while (!p->c_queue.empty() &&
+		       LOG_DATA_INTERNAL(p->c_queue.front()->cmd)) {
+			p->c_queue.pop();
+			reply_failure_to_client(p);
+		}
+
+		if (p->c_queue.empty())
+			return;
+
+		/* handing leadership over, hold on to the commands until it's done */
+		if (this->state == LEADER && this->transferee != nullptr) {
+			this->clients_parked = true;
+			return;
+		}
+
+		/* proxy the command instead of sending the client away, reads have a value to carry back */
+		if (this->state != LEADER && this->forward_to_leader &&
+		    leader_reachable() && !p->c_queue.front()->read) {
+			forward_cmd_to_leader(p);
+			return;
+		}
+
+		/*
+		* redirect client to real leader, one reply for each queued
+		* command since clients match replies by order.
+		*/
+		if (this->state != LEADER) {
+			while (!p->c_queue.empty()) {
+				p->c_queue.pop();
+				reply_redirect_to_client(p);
+			}
+
+			return;
+		}
+
+		p->cur_cmd = p->c_queue.front();
+		p->c_queue.pop();
+
+		if (p->cur_cmd->read) {
+			start_read(p);
+			return;
+		}
+
+		log_entry_t &e = this->log->get_last_log();
+		
+		this->log->get_entries().push_back({e.index + 1, 
+			                                (int32_t)this->meta->term(),
+			                                p->cur_cmd->cmd});
+		/*
+		* for future reply to client.
+		*/
+		p->cur_cmd->index = e.index + 1;
+		p->cur_cmd->term = this->meta->term();
+		arm_client_deadline(p);
+
+		send_append_entries();
+	}
+
+	/*
+	* queue the client's next command for the leader.
+	*/
+	void whale_server::forward_cmd_to_leader(peer_t * client) {
+		client->cur_cmd = client->c_queue.front();
+		client->c_queue.pop();
+		client->forward_id = ++this->forward_seq;
+		arm_client_deadline(client);
+
+		this->forwarding[client->forward_id] = client->addr;
+		this->forward_batch.cmds.push_back({client->forward_id,
+		                                    client->cur_cmd->cmd});
+
+		if (this->forward_batch.cmds.size() >= WHALE_FORWARD_BATCH) {
+			flush_forward_batch();
+			return;
+		}
+
+		if (event_in_reactor(&this->forward_event))
+			return;
+
+		event_set(&this->forward_event, 0, E_TIMEOUT, forward_callback, this);
+
+		if (reactor_add_event(&this->r, &this->forward_event) == -1) {
+			log_error("failed to reactor_add_event for"
+			          " forward event: %s", ::strerror(errno));
+			flush_forward_batch();
+		}
+	}
+
+	/*
+	* send every queued client command to the leader in one message.
+	*/
+	void whale_server::flush_forward_batch() {
+		remove_event_if_in_reactor(&this->forward_event);
+
+		if (this->forward_batch.cmds.empty())
+			return;
+
+		if (!leader_reachable()) {
+			fail_forwarding();
+			return;
+		}
+
+		queue_bulk(this->cur_leader,
+		           msg_sptr{make_msg_from_forward_cmds(this->forward_batch)});
+		this->forward_batch.cmds.clear();
+
+		handle_write_to_peer(this->cur_leader);
+	}
+
+	/*
+	* the leader we forwarded to is gone, redirect every client still
+	* waiting for a forwarded command.
+	*/
+	void whale_server::fail_forwarding() {
+		std::map<w_uint_t, w_addr_t> waiting;
+
+		remove_event_if_in_reactor(&this->forward_event);
+		this->forward_batch.cmds.clear();
+		waiting.swap(this->forwarding);
+
+		for (auto & it : waiting) {
+			auto cit = this->clients.find(it.second);
+
+			if (cit == this->clients.end() ||
+			    cit->second.cur_cmd.get() == nullptr ||
+			    cit->second.forward_id != it.first)
+				continue;
+
+			finish_client_cmd(&cit->second);
+			reply_redirect_to_client(&cit->second);
+
+			if (!cit->second.c_queue.empty())
+				process_cmd_request(&cit->second);
+		}
+
+		/* read indexes asked of that leader won't come either */
+		remove_event_if_in_reactor(&this->read_index_event);
+		this->read_index_open = 0;
+
+		for (auto & it : this->clients) {
+			peer_t * client = &it.second;
+
+			if (client->cur_cmd.get() == nullptr || !client->cur_cmd->read ||
+			    client->cur_cmd->index != WHALE_READ_PENDING)
+				continue;
+
+			finish_client_cmd(client);
+			reply_redirect_to_client(client);
+
+			if (!client->c_queue.empty())
+				process_cmd_request(client);
+		}
+	}
+
+	/*
+	* leader side: append commands forwarded by follower @p.
+	*/
+	void whale_server::process_forward_cmds(peer_t * p, msg_sptr msg) {
+		fc_uptr fc{make_forward_cmds_from_msg(*msg)};
+
+		if (fc.get() == nullptr) {
+			log_error("malformed forward command message");
+			return;
+		}
+
+		/*
+		* not the leader any more or handing leadership over,
+		* the follower redirects its clients.
+		*/
+		if (this->state != LEADER || this->transferee != nullptr) {
+			forward_cmds_res_t fcr;
+
+			for (forward_cmd_t & c : fc->cmds)
+				fcr.results.push_back({c.id, false, 0});
+
+			queue_bulk(p, msg_sptr{make_msg_from_forward_cmds_res(fcr)});
+			handle_write_to_peer(p);
+			return;
+		}
+
+		for (forward_cmd_t & c : fc->cmds) {
+			log_entry_t &e = this->log->get_last_log();
+			w_int_t      idx = e.index + 1;
+
+			this->log->get_entries().push_back({(int32_t)idx,
+			                                    (int32_t)this->meta->term(),
+			                                    c.cmd});
+			this->forwarded.push_back({p, c.id, idx, this->meta->term()});
+		}
+
+		send_append_entries();
+	}
+
+	/*
+	* follower side: relay results of forwarded commands to the clients.
+	*/
+	void whale_server::process_forward_cmds_res(peer_t * p, msg_sptr msg) {
+		fcr_uptr fcr{make_forward_cmds_res_from_msg(*msg)};
+
+		if (fcr.get() == nullptr) {
+			log_error("malformed forward command result message");
+			return;
+		}
+
+		for (forward_res_t & r : fcr->results) {
+			auto it = this->forwarding.find(r.id);
+
+			if (it == this->forwarding.end())
+				continue;
+
+			auto cit = this->clients.find(it->second);
+			this->forwarding.erase(it);
+
+			/* client went away or reconnected meanwhile */
+			if (cit == this->clients.end() ||
+			    cit->second.cur_cmd.get() == nullptr ||
+			    cit->second.forward_id != r.id)
+				continue;
+
+			peer_t * client = &cit->second;
+
+			finish_client_cmd(client);
+
+			if (r.res)
+				reply_success_to_client(client, r.index);
+			else
+				reply_redirect_to_client(client);
+
+			if (!client->c_queue.empty())
+				process_cmd_request(client);
+		}
+	}
+
+	/*
+	* leader side: tell followers which forwarded commands got applied.
+	* commands are answered in log order, one message per follower.
+	*/
+	void whale_server::reply_forwarded() {
+		std::map<peer_t *, forward_cmds_res_t> results;
+
+		while (!this->forwarded.empty() &&
+		       this->forwarded.front().index <= this->last_applied) {
+			forwarded_cmd_t & f = this->forwarded.front();
+			log_entry_it      it = this->log->find_by_idx(f.index);
+
+			/* an entry overwritten by another leader was not committed */
+			results[f.from].results.push_back({f.id,
+			        it != this->log->get_entries().end() && it->term == f.term,
+			        f.index});
+
+			this->forwarded.pop_front();
+		}
+
+		for (auto & it : results) {
+			queue_bulk(it.first, msg_sptr{make_msg_from_forward_cmds_res(it.second)});
+			handle_write_to_peer(it.first);
+		}
+	}
+
+#ifdef WHALE_HAVE_IO_URING
+	w_rc_t whale_server::init_uring() {
+		std::unique_ptr<uring> ring(new uring);
+
+		if (ring->init(WHALE_URING_ENTRIES) != WHALE_GOOD)
+			return WHALE_ERROR;
+
+		if ((this->ring_efd = ::eventfd(0, EFD_NONBLOCK)) == -1) {
+			log_error("failed to create eventfd: %s", ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		if (ring->register_eventfd(this->ring_efd) == -1) {
+			log_error("failed to register eventfd: %s", ::strerror(errno));
+			goto fail;
+		}
+
+		::memset(&this->ring_submit_event, 0, sizeof(struct event));
+		event_set(&this->ring_event, this->ring_efd, E_READ,
+		          uring_callback, this);
+
+		if (reactor_add_event(&this->r, &this->ring_event) == -1) {
+			log_error("failed to reactor_add_event for ring event: %s",
+			          ::strerror(errno));
+			goto fail;
+		}
+
+		this->ring = std::move(ring);
+		return this->log->use_uring(this->ring.get());
+
+	fail:
+		TEMP_FAILURE_RETRY(close(this->ring_efd));
+		return WHALE_ERROR;
+	}
+
+	void whale_server::arm_uring_submit() {
+		if (event_in_reactor(&this->ring_submit_event))
+			return;
+
+		event_set(&this->ring_submit_event, 0, E_TIMEOUT,
+		          uring_submit_callback, this);
+
+		if (reactor_add_event(&this->r, &this->ring_submit_event) == -1) {
+			log_error("failed to reactor_add_event for"
+			          " ring submit event: %s", ::strerror(errno));
+			this->ring->submit();
+		}
+	}
+
+	void whale_server::submit_uring() {
+		std::deque<w_uint_t> backlog;
+
+		remove_event_if_in_reactor(&this->ring_submit_event);
+
+		if (this->ring->submit() == -1) {
+			/* completion queue is full, try again after reaping */
+			log_error("failed to submit to the ring: %s", ::strerror(errno));
+			arm_uring_submit();
+			return;
+		}
+
+		/* room again for sends that didn't fit */
+		backlog.swap(this->ring_backlog);
+		for (w_uint_t id : backlog) {
+			auto it = this->conn_peers.find(id);
+
+			if (it != this->conn_peers.end())
+				handle_write_to_peer(it->second);
+		}
+	}
+
+	/*
+	* queue a sendmsg of @p's write_queue, at most one is in flight per peer.
+	*/
+	void whale_server::uring_send(peer_t * p) {
+		struct io_uring_sqe * sqe;
+		uring_send_t        * s;
+		size_t                cnt = 0;
+
+		if (p->send_inflight || !has_output(p))
+			return;
+
+		merge_control(p);
+
+		if ((sqe = this->ring->get_sqe()) == nullptr) {
+			this->ring_backlog.push_back(p->conn_id);
+			arm_uring_submit();
+			return;
+		}
+
+		s = new uring_send_t;
+		s->conn_id = p->conn_id;
+		s->conn_gen = p->conn_gen;
+
+		for (msg_q_elt & elt : p->write_queue) {
+			if (cnt == WHALE_WRITE_IOV)
+				break;
+
+			s->iov[cnt].iov_base = (char *)elt.msg.get() + elt.pin;
+			s->iov[cnt].iov_len = MESSAGE_SIZE(elt.msg) - elt.pin;
+			s->frames.push_back(elt.msg);
+			++cnt;
+		}
+
+		::memset(&s->mh, 0, sizeof(s->mh));
+		s->mh.msg_iov = s->iov;
+		s->mh.msg_iovlen = cnt;
+
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd = p->e.fd;
+		sqe->addr = (uint64_t)(uintptr_t)&s->mh;
+		sqe->len = 1;
+		sqe->msg_flags = MSG_NOSIGNAL;
+		sqe->user_data = URING_DATA(URING_OP_SEND, (uintptr_t)s);
+
+		p->send_inflight = true;
+		arm_uring_submit();
+	}
+
+	void whale_server::complete_uring_send(uring_send_t * s, int32_t res) {
+		std::unique_ptr<uring_send_t> guard(s);
+		peer_t                       *p = find_conn(s->conn_id, s->conn_gen);
+
+		/* connection or whole entry went away meanwhile, its queue too */
+		if (p == nullptr)
+			return;
+
+		p->send_inflight = false;
+
+		if (res < 0) {
+			if (res == -EINTR || res == -EAGAIN) {
+				uring_send(p);
+				return;
+			} else if (res == -EPIPE || res == -ECONNRESET) {
+				/* peer closed connection */
+				peer_cleanup(p);
+				return;
+			}
+
+			/* error occured */
+			log_error("error occured during sendmsg to fd[%d]: %s",
+			          p->e.fd, ::strerror(-res));
+			::abort();
+		}
+
+		advance_write_queue(p, res);
+		uring_send(p);
+	}
+
+	/*
+	* reap completions of the ring.
+	*/
+	void whale_server::handle_uring_completions() {
+		struct io_uring_cqe * cqe;
+		uint64_t              cnt;
+		bool                  log_done = false;
+
+		while (::read(this->ring_efd, &cnt, sizeof(cnt)) == -1 && errno == EINTR)
+			continue;
+
+		while ((cqe = this->ring->peek_cqe()) != nullptr) {
+			uint64_t data = cqe->user_data;
+			int32_t  res = cqe->res;
+
+			this->ring->cqe_seen();
+
+			switch (URING_KIND(data)) {
+			case URING_OP_SEND:
+				complete_uring_send(reinterpret_cast<uring_send_t *>(
+				                    (uintptr_t)URING_VALUE(data)), res);
+				break;
+			case URING_OP_LOG:
+				this->log->complete(URING_VALUE(data), res);
+				log_done = true;
+				break;
+			}
+		}
+
+		/* commands whose entries reached the disk can be answered now */
+		if (log_done) {
+			apply_log();
+			if (this->state == LEADER)
+				reply_clients();
+			else
+				reply_reads();
+		}
+	}
+#endif
+
+	w_rc_t whale_server::start_workers(w_int_t n) {
+		if ((this->worker_wake.efd = ::eventfd(0, EFD_NONBLOCK)) == -1) {
+			log_error("failed to create eventfd: %s", ::strerror(errno));
+			return WHALE_ERROR;
+		}
+		this->worker_wake.pending.store(false);
+
+		event_set(&this->worker_event, this->worker_wake.efd, E_READ,
+		          worker_events_callback, this);
+
+		if (reactor_add_event(&this->r, &this->worker_event) == -1) {
+			log_error("failed to reactor_add_event for worker events: %s",
+			          ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		for (w_int_t i = 0; i < n; ++i) {
+			std::unique_ptr<io_worker> w(new io_worker(&this->worker_events,
+			                                           &this->worker_wake));
+
+			if (w->start() != WHALE_GOOD)
+				return WHALE_ERROR;
+
+			this->workers.push_back(std::move(w));
+		}
+
+		return WHALE_GOOD;
+	}
+
+	/*
+	* gets one SO_REUSEPORT listening socket per acceptor thread, the
+	* kernel spreads incoming clients over them.
+	*/
+	w_rc_t whale_server::start_acceptors(w_int_t n, w_addr_t * addr) {
+		if ((this->accept_wake.efd = ::eventfd(0, EFD_NONBLOCK)) == -1) {
+			log_error("failed to create eventfd: %s", ::strerror(errno));
+			return WHALE_ERROR;
+		}
+		this->accept_wake.pending.store(false);
+
+		event_set(&this->accept_event, this->accept_wake.efd, E_READ,
+		          accepted_callback, this);
+
+		if (reactor_add_event(&this->r, &this->accept_event) == -1) {
+			log_error("failed to reactor_add_event for accept event: %s",
+			          ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		for (w_int_t i = 0; i < n; ++i) {
+			el_socket_t fd = make_listen_fd(addr, this->backlog, this->client_opts, true);
+
+			if (fd == -1)
+				return WHALE_ERROR;
+
+			std::unique_ptr<io_acceptor> a(new io_acceptor(fd, &this->accepted,
+			                                               &this->accept_wake));
+
+			if (a->start() != WHALE_GOOD) {
+				TEMP_FAILURE_RETRY(close(fd));
+				return WHALE_ERROR;
+			}
+
+			this->acceptors.push_back(std::move(a));
+		}
+
+		return WHALE_GOOD;
+	}
+
+	/*
+	* requests decoded by io workers enter the state machine here, on the
+	* reactor thread, so it stays single threaded.
+	*/
+	void whale_server::handle_worker_events() {
+		worker_event_t ev;
+
+		wake_consume(&this->worker_wake);
+
+		while (this->worker_events.pop(ev)) {
+			auto wit = this->worker_conns.find(ev.conn_id);
+
+			if (wit == this->worker_conns.end())
+				continue;
+
+			auto cit = this->clients.find(wit->second);
+
+			/* the address got reused by a newer connection */
+			if (cit == this->clients.end() ||
+			    cit->second.conn_id != ev.conn_id) {
+				if (ev.type == WORKER_EV_CLOSED)
+					this->worker_conns.erase(wit);
+				continue;
+			}
+
+			switch (ev.type) {
+			case WORKER_EV_CMD:
+				cit->second.c_queue.push(ev.cmd);
+				if (cit->second.cur_cmd.get() == nullptr)
+					process_cmd_request(&cit->second);
+				break;
+			case WORKER_EV_CLOSED:
+				this->worker_conns.erase(wit);
+				this->timers.cancel(&cit->second.deadline);
+				this->conn_peers.erase(cit->second.conn_id);
+				this->clients.erase(cit);
+				break;
+			}
+		}
+	}
+
+	/*
+	* handles a fully read message from peer @p.
+	*/
+	void whale_server::process_message(peer_t * p, msg_sptr msg) {
+		switch (::htonl(msg->msg_type)) {
+		case MESSAGE_REQUEST_VOTE:
+		case MESSAGE_PRE_VOTE:
+			process_request_vote(p, msg);
+			break;
+		case MESSAGE_REQUEST_VOTE_RES:
+		case MESSAGE_PRE_VOTE_RES:
+			process_request_vote_res(p, msg);
+			break;
+		case MESSAGE_APPEND_ENTRIES:
+			process_append_entries(p, msg);
+			break;
+		case MESSAGE_APPEND_ENTRIES_RES:
+			process_append_entries_res(p, msg);
+			break;
+		case MESSAGE_CMD_REQUEST:
+		case MESSAGE_READ_REQUEST:
+			p->c_queue.push(cmd_sptr{make_cmd_request_from_msg(*msg.get())});
+			if (p->cur_cmd.get() == nullptr) {
+				process_cmd_request(p);
+			}
+			break;
+		case MESSAGE_FORWARD_CMD:
+			process_forward_cmds(p, msg);
+			break;
+		case MESSAGE_FORWARD_CMD_RES:
+			process_forward_cmds_res(p, msg);
+			break;
+		case MESSAGE_TIMEOUT_NOW:
+			process_timeout_now(p, msg);
+			break;
+		case MESSAGE_READ_INDEX:
+			process_read_index(p, msg);
+			break;
+		case MESSAGE_READ_INDEX_RES:
+			process_read_index_res(p, msg);
+			break;
+		}
+	}
+
+	/*
+	* handles every complete frame in @p's receive buffer in place.
+	* the payload is nul-terminated for the json parser by borrowing the
+	* byte right after the frame, which is put back afterwards.
+	* Return: false if the connection got closed meanwhile.
+	*/
+	bool whale_server::process_rbuf(peer_t * p) {
+		std::shared_ptr<char> buf = p->rbuf;
+		uint32_t              len;
+		char                  saved;
+
+		while (p->rbuf_end - p->rbuf_start >= sizeof(uint32_t)) {
+			char * frame = buf.get() + p->rbuf_start;
+
+			::memcpy(&len, frame, sizeof(uint32_t));
+			len = ::ntohl(len);
+
+			if (len < sizeof(message_t)) {
+				log_error("invalid message length %u from fd[%d]",
+				          len, p->e.fd);
+				peer_cleanup(p);
+				return false;
+			}
+
+			/* won't ever fit, read the rest into a buffer of its own */
+			if (len > WHALE_RECV_BUF) {
+				uint32_t avail = p->rbuf_end - p->rbuf_start;
+
+				p->spill.msg = msg_sptr(reinterpret_cast<message_t *>(
+				                        new char[len + 1]));
+				::memcpy(p->spill.msg.get(), frame, avail);
+				((char *)p->spill.msg.get())[len] = '\0';
+				p->spill.pin = avail;
+				p->rbuf_start = p->rbuf_end = 0;
+				return true;
+			}
+
+			if (p->rbuf_end - p->rbuf_start < len)
+				break;
+
+			p->rbuf_start += len;
+
+			/* the message shares ownership of the buffer */
+			saved = frame[len];
+			frame[len] = '\0';
+			process_message(p, msg_sptr(buf, reinterpret_cast<message_t *>(frame)));
+			frame[len] = saved;
+
+			if (!event_in_reactor(&p->e))
+				return false;
+		}
+
+		if (p->rbuf_start == p->rbuf_end)
+			p->rbuf_start = p->rbuf_end = 0;
+
+		return true;
+	}
+
+	/*
+	* make room at the tail of @p's receive buffer by moving the partial
+	* frame to the front. a buffer still referenced by a message is left
+	* alone and replaced.
+	*/
+	void whale_server::compact_rbuf(peer_t * p) {
+		uint32_t avail = p->rbuf_end - p->rbuf_start;
+
+		if (p->rbuf.get() == nullptr || p->rbuf.use_count() > 1) {
+			std::shared_ptr<char> buf(new char[WHALE_RECV_BUF + 1],
+			                          std::default_delete<char[]>());
+
+			if (avail)
+				::memcpy(buf.get(), p->rbuf.get() + p->rbuf_start, avail);
+			p->rbuf = buf;
+		} else if (p->rbuf_start) {
+			::memmove(p->rbuf.get(), p->rbuf.get() + p->rbuf_start, avail);
+		}
+
+		p->rbuf_start = 0;
+		p->rbuf_end = avail;
+	}
+
+	/*
+	* read a frame too large for the receive buffer.
+	* Return: true once it is complete, false if more is to come or the
+	* connection got closed.
+	*/
+	bool whale_server::read_spill(peer_t * p) {
+		msg_q_elt & elt = p->spill;
+		uint32_t    size = MESSAGE_SIZE(elt.msg);
+		ssize_t     nread;
+
+		while (elt.pin < size) {
+			nread = ::read(p->e.fd, (char *)elt.msg.get() + elt.pin,
+			               size - elt.pin);
+
+			if (nread <= 0) {
+				if (nread == 0) { /* peer closed connection */
+					peer_cleanup(p);
+					return false;
+				} else if (errno == EINTR) { /* retry */
+					continue;
+				} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					return false;
+				}
+				/* error occured */
+				log_error("error occured during ::read() from fd[%d]: %s",
+				          p->e.fd, ::strerror(errno));
+				::abort();
+			}
+			elt.pin += nread;
+		}
+
+		return true;
+	}
+
+	/* 
+	* read from peer into its receive buffer with one ::read() per round
+	* and handle every complete message in it, until the socket is
+	* drained.
+	*/
+	void whale_server::handle_read_from_peer(peer_t * p) {
+		el_socket_t fd = p->e.fd;
+		ssize_t     nread;
+		uint32_t    room;
+
+		for (;;) {
+			if (p->spill.msg.use_count()) {
+				if (!read_spill(p))
+					return;
+
+				msg_sptr msg = p->spill.msg;
+
+				p->spill = {0, 0, msg_sptr()};
+				process_message(p, msg);
+
+				if (!event_in_reactor(&p->e))
+					return;
+			}
+
+			if (p->rbuf.get() == nullptr || p->rbuf_end == WHALE_RECV_BUF)
+				compact_rbuf(p);
+
+			room = WHALE_RECV_BUF - p->rbuf_end;
+			nread = ::read(fd, p->rbuf.get() + p->rbuf_end, room);
+
+			if (nread <= 0) {
+				if (nread == 0) { /* peer closed connection */
+					peer_cleanup(p);
+					return;
+				} else if (errno == EINTR) { /* retry */
+					continue;
+				} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					return;
+				}
+				/* error occured */
+				log_error("error occured during ::read() from fd[%d]: %s",
+					      fd, ::strerror(errno));
+				::abort();
+			}
+
+			p->rbuf_end += nread;
+
+			if (!process_rbuf(p))
+				return;
+
+			/*
+			* a short read drained the socket, a level-triggered reactor
+			* tells us about more data. edge-triggered wants EAGAIN first.
+			*/
+			if ((uint32_t)nread < room && !this->edge_triggered &&
+			    p->spill.msg.use_count() == 0)
+				return;
+		}
+	}
+	
+
+	inline void 
+	whale_server::remove_event_if_in_reactor(struct event * e) {
+		if (event_in_reactor(e))
+			reactor_remove_event(&this->r, e);
+	}
+
+	void whale_server::reset_reconnect_timer(peer_t * p) {
+		/* 
+		*  connect is in progress or peer is not online,
+		*  setup a timer to reconnect after a period of time.
+		*/
+		this->timers.add(&p->reconnect_timer, WHALE_RECONNECT_TIMEOUT,
+		                 peer_reconnect_callback, p);
+	}
+
+	/*
+	* turn the timer wheel, then wait for the next tick.
+	*/
+	void whale_server::handle_tick() {
+		this->timers.advance();
+
+		event_set(&this->tick_event, WHALE_TIMER_TICK, E_TIMEOUT,
+		          tick_callback, this);
+
+		if (reactor_add_event(&this->r, &this->tick_event) == -1)
+			log_error("failed to reactor_add_event for tick event: %s",
+			          ::strerror(errno));
+	}
+
+	void whale_server::peer_cleanup(peer_t * p) {
+		p->connected = false;
+		p->send_inflight = false;
+		++p->conn_gen;
+		p->rbuf.reset();
+		p->rbuf_start = p->rbuf_end = 0;
+		p->spill = {0, 0, msg_sptr()};
+		msg_queue().swap(p->write_queue);
+		msg_queue().swap(p->ctrl_queue);
+		/* queued entries are gone, resume from what the peer is known to have */
+		p->queued_bytes = 0;
+		forget_rpcs(p);
+		p->probing = true;
+		p->next_idx = p->match_idx + 1;
+		finish_client_cmd(p);
+		remove_event_if_in_reactor(&p->e);
+		if (p->need_to_reconnect)
+			reset_reconnect_timer(p);
+#ifdef WHALE_HAVE_IO_URING
+		/* a queued send must reach the kernel before its fd is reused */
+		if (uring_engine() && this->ring->pending())
+			submit_uring();
+#endif
+		TEMP_FAILURE_RETRY(close(p->e.fd));
+
+		/* forwarded commands died with the leader connection */
+		if (p == this->cur_leader)
+			fail_forwarding();
+	}
+
+	void whale_server::queue_control(peer_t * p, msg_sptr msg) {
+		p->queued_bytes += MESSAGE_SIZE(msg);
+		p->ctrl_queue.push_back({0, 0, msg});
+	}
+
+	void whale_server::queue_bulk(peer_t * p, msg_sptr msg) {
+		p->queued_bytes += MESSAGE_SIZE(msg);
+		p->write_queue.push_back({0, 0, msg});
+	}
+
+	/*
+	* remember request @id sent to @p until its reply comes or
+	* rpc_timeout ms passed.
+	*/
+	void whale_server::track_rpc(peer_t * p, w_uint_t id, w_int_t type,
+	                             bool heartbeat, w_int_t last_idx) {
+		rpc_t & rpc = p->rpcs[id];
+
+		rpc.id = id;
+		rpc.type = type;
+		rpc.term = this->meta->term();
+		rpc.heartbeat = heartbeat;
+		rpc.last_idx = last_idx;
+		rpc.read_round = this->read_round;
+		rpc.sent_at = this->timers.now();
+		rpc.p = p;
+		rpc.timer = INIT_TIMER;
+		this->timers.add(&rpc.timer, this->rpc_timeout, rpc_timeout_callback, &rpc);
+
+		if (type == MESSAGE_APPEND_ENTRIES && !heartbeat)
+			++p->inflight_ae;
+	}
+
+	/*
+	* pair a reply from @p with its request, copied into @rpc.
+	* Return: false if no request @id is outstanding.
+	*/
+	bool whale_server::complete_rpc(peer_t * p, w_uint_t id, rpc_t * rpc) {
+		auto it = p->rpcs.find(id);
+
+		if (it == p->rpcs.end())
+			return false;
+
+		this->timers.cancel(&it->second.timer);
+		*rpc = it->second;
+		p->rpcs.erase(it);
+		return true;
+	}
+
+	/*
+	* drop every AppendEntries carrying entries to @p, their replies
+	* get ignored when they show up.
+	*/
+	void whale_server::forget_append_entries(peer_t * p) {
+		for (auto it = p->rpcs.begin(); it != p->rpcs.end();) {
+			if (it->second.type == MESSAGE_APPEND_ENTRIES &&
+			    !it->second.heartbeat) {
+				this->timers.cancel(&it->second.timer);
+				it = p->rpcs.erase(it);
+			} else {
+				++it;
+			}
+		}
+
+		p->inflight_ae = 0;
+	}
+
+	void whale_server::forget_rpcs(peer_t * p) {
+		for (auto & it : p->rpcs)
+			this->timers.cancel(&it.second.timer);
+
+		p->rpcs.clear();
+		p->inflight_ae = 0;
+	}
+
+	/*
+	* @rpc got no reply in time. A lost AppendEntries leaves a hole in
+	* the pipeline, so the peer is probed again from what it is known
+	* to have. Votes and heartbeats are simply forgotten, the election
+	* and heartbeat timers send new ones.
+	*/
+	void whale_server::rpc_timed_out(rpc_t * rpc) {
+		peer_t * p = rpc->p;
+		bool     entries = rpc->type == MESSAGE_APPEND_ENTRIES &&
+		                   !rpc->heartbeat &&
+		                   rpc->term == this->meta->term();
+
+		p->rpcs.erase(rpc->id);
+
+		if (!entries || this->state != LEADER)
+			return;
+
+		log_error("AppendEntries to %s timed out",
+		          w_addr_to_string(p->addr).c_str());
+
+		p->probing = true;
+		forget_append_entries(p);
+		p->next_idx = p->match_idx + 1;
+		replicate_to(p);
+	}
+
+	/*
+	* move control messages into @p's write_queue right after the frame
+	* being written, a frame never gets interleaved with another one.
+	* only called while no write of @write_queue is in flight.
+	*/
+	void whale_server::merge_control(peer_t * p) {
+		if (p->ctrl_queue.empty())
+			return;
+
+		msg_queue::iterator pos = p->write_queue.begin();
+
+		if (pos != p->write_queue.end() && pos->pin != 0)
+			++pos;
+
+		p->write_queue.insert(pos, p->ctrl_queue.begin(), p->ctrl_queue.end());
+		p->ctrl_queue.clear();
+	}
+
+	/*
+	* retire fully written frames, advance into the partial one.
+	*/
+	void whale_server::advance_write_queue(peer_t * p, size_t n) {
+		p->queued_bytes -= std::min(p->queued_bytes, n);
+
+		while (n > 0 && !p->write_queue.empty()) {
+			msg_q_elt & elt = p->write_queue.front();
+			size_t      left = MESSAGE_SIZE(elt.msg) - elt.pin;
+
+			if (n < left) {
+				elt.pin += n;
+				break;
+			}
+
+			n -= left;
+			p->write_queue.pop_front();
+		}
+	}
+
+	/*
+	* write as many as messages to peer until the socket buffer is full.
+	* queued frames are gathered into one ::sendmsg() of up to
+	* WHALE_WRITE_IOV frames, @pin of the first one tells how much of it
+	* went out already.
+	*/
+	void whale_server::handle_write_to_peer(peer_t * p) {
+		el_socket_t   fd = p->e.fd;
+		struct iovec  iov[WHALE_WRITE_IOV];
+		struct msghdr mh;
+		size_t        cnt;
+		size_t        total;
+		ssize_t       nwrite;
+		bool          short_write;
+
+		/* connection is down, nothing to write to */
+		if (!event_in_reactor(&p->e))
+			return;
+#ifdef WHALE_HAVE_IO_URING
+		/* the send completes through handle_uring_completions() */
+		if (uring_engine()) {
+			uring_send(p);
+			return;
+		}
+#endif
+		while (has_output(p)) {
+			cnt = 0;
+			total = 0;
+
+			merge_control(p);
+
+			for (msg_q_elt & elt : p->write_queue) {
+				if (cnt == WHALE_WRITE_IOV)
+					break;
+
+				iov[cnt].iov_base = (char *)elt.msg.get() + elt.pin;
+				iov[cnt].iov_len = MESSAGE_SIZE(elt.msg) - elt.pin;
+				total += iov[cnt++].iov_len;
+			}
+
+			::memset(&mh, 0, sizeof(mh));
+			mh.msg_iov = iov;
+			mh.msg_iovlen = cnt;
+
+			/* a closed peer shows up as EPIPE rather than SIGPIPE */
+			nwrite = ::sendmsg(fd, &mh, MSG_NOSIGNAL);
+
+			if (nwrite == -1) {
+				/* socket buffer might not have enough available space */
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					break;
+				} else if (errno == EINTR) { /* retry */
+					continue;
+				} else if (errno == EPIPE || errno == ECONNRESET) {
+					/* peer closed connection */
+					peer_cleanup(p);
+					return;
+				}
+
+				/* error occured */
+				log_error("error occured during ::sendmsg() to fd[%d]: %s",
+					      fd, ::strerror(errno));
+				::abort();
+			}
+
+			/* short write, the socket buffer is full */
+			short_write = (size_t)nwrite < total;
+
+			advance_write_queue(p, nwrite);
+
+			/* edge-triggered sockets only fire again after EAGAIN */
+			if (short_write && !this->edge_triggered)
+				break;
+		}
+
+		/* wait for writability only while messages are pending */
+		update_write_interest(p);
+	}
+
+	/*
+	* reset this local's election timer event.
+	*/
+	void whale_server::reset_elec_timeout_event() {
+		/* start timer with a random period of time for election*/
+		this->timers.add(&this->elec_timer,
+		                 NEXT_TIMEOUT(WHALE_MIN_ELEC_TIMEOUT, WHALE_MAX_ELEC_TIMEOUT),
+		                 elec_timeout_callback, this);
+	}
+
+	/*
+	* election timeout elapsed. ask peers whether they would vote for us
+	* in the next term, without moving to it. a node that got partitioned
+	* away then can't force a healthy leader to step down by coming back
+	* with a higher term.
+	*/
+	void whale_server::start_pre_vote() {
+		request_vote_t rv;
+
+		/* learners and servers removed from the cluster don't campaign */
+		if (!self_voter()) {
+			reset_elec_timeout_event();
+			return;
+		}
+
+		if (!this->pre_vote) {
+			turn_into_candidate();
+			return;
+		}
+
+		this->state = PRE_CANDIDATE;
+		this->vote_count = 1; /* our own */
+
+		/* try again later if we don't get a majority */
+		reset_elec_timeout_event();
+
+		if (this->vote_count > voters() / 2) {
+			turn_into_candidate();
+			return;
+		}
+
+		rv.term = this->meta->term() + 1;
+		rv.candidate_id = this->self;
+		rv.last_log_idx = this->log->get_last_log().index;
+		rv.last_log_term = this->log->get_last_log().term;
+		rv.rpc_id = ++this->rpc_seq;
+		rv.pre_vote = true;
+		rv.transfer = false;
+
+		msg_sptr m = msg_sptr(make_msg_from_request_vote(rv));
+
+		for (auto & it : this->servers) {
+			if (!it.second.connected) continue;
+			track_rpc(&it.second, rv.rpc_id, MESSAGE_PRE_VOTE);
+			queue_control(&it.second, m);
+			handle_write_to_peer(&it.second);
+		}
+	}
+
+	/*
+	* hand leadership over to @target: stop taking new commands, bring
+	* @target up to date and tell it to start an election right away,
+	* which it wins having the most recent log.
+	* Return: WHALE_GOOD if the transfer started, WHALE_ERROR otherwise.
+	*/
+	w_rc_t whale_server::transfer_leadership(peer_t * target) {
+		if (this->state != LEADER || target == nullptr || !target->connected ||
+		    !target->member || target->learner) {
+			log_error("leadership transfer needs a leader and a connected voter");
+			return WHALE_ERROR;
+		}
+
+		if (this->transferee != nullptr) {
+			log_error("leadership transfer already in progress");
+			return WHALE_ERROR;
+		}
+
+		log_error("transferring leadership to %s",
+		          w_addr_to_string(target->addr).c_str());
+
+		this->transferee = target;
+		this->timeout_now_sent = false;
+		this->timers.add(&this->transfer_timer, WHALE_TRANSFER_TIMEOUT,
+		                 transfer_timeout_callback, this);
+
+		if (target->match_idx == this->log->get_last_log().index)
+			send_timeout_now(target);
+		else
+			replicate_to(target);
+
+		return WHALE_GOOD;
+	}
+
+	void whale_server::handle_transfer_signal() {
+		peer_t * target = nullptr;
+
+		for (auto & it : this->servers) {
+			peer_t * p = &it.second;
+
+			if (!p->connected || !p->member || p->learner)
+				continue;
+
+			if (!this->transfer_to.empty()) {
+				if (w_addr_to_string(p->addr) == this->transfer_to)
+					target = p;
+			} else if (target == nullptr || p->match_idx > target->match_idx) {
+				target = p;
+			}
+		}
+
+		transfer_leadership(target);
+
+		/* in case the reactor fires signal events only once */
+		if (!event_in_reactor(&this->transfer_event) &&
+		    reactor_add_event(&this->r, &this->transfer_event) == -1)
+			log_error("failed to reactor_add_event for SIGUSR1: %s",
+			          ::strerror(errno));
+	}
+
+	void whale_server::send_timeout_now(peer_t * p) {
+		timeout_now_t t;
+
+		t.term = this->meta->term();
+		this->timeout_now_sent = true;
+
+		queue_control(p, msg_sptr(make_msg_from_timeout_now(t)));
+		handle_write_to_peer(p);
+	}
+
+	/*
+	* follower side: our leader wants us to take over, skip the
+	* election timeout and the pre-vote, our log is as recent as its.
+	*/
+	void whale_server::process_timeout_now(peer_t * p, msg_sptr msg) {
+		tn_uptr tn{make_timeout_now_from_msg(*msg)};
+
+		if (tn.get() == nullptr) {
+			log_error("malformed timeout now message");
+			return;
+		}
+
+		if (tn->term != this->meta->term() || this->state != FOLLOWER ||
+		    this->cur_leader != p || !self_voter())
+			return;
+
+		turn_into_candidate(true);
+	}
+
+	/*
+	* the transfer didn't complete in time, keep leading.
+	*/
+	void whale_server::abort_transfer() {
+		if (this->transferee == nullptr)
+			return;
+
+		log_error("leadership transfer to %s timed out",
+		          w_addr_to_string(this->transferee->addr).c_str());
+
+		end_transfer();
+
+		if (this->clients_parked)
+			resume_parked_clients();
+	}
+
+	void whale_server::end_transfer() {
+		this->transferee = nullptr;
+		this->timeout_now_sent = false;
+		this->timers.cancel(&this->transfer_timer);
+	}
+
+	/*
+	* go on with client commands held back during a transfer.
+	*/
+	void whale_server::resume_parked_clients() {
+		this->clients_parked = false;
+
+		for (auto & it : this->clients) {
+			if (it.second.cur_cmd.get() == nullptr &&
+			    !it.second.c_queue.empty())
+				process_cmd_request(&it.second);
+		}
+	}
+
+	/*
+	* the active configuration is the last one in the log, committed or
+	* not, or the one we were started with.
+	*/
+	void whale_server::load_members() {
+		std::vector<log_entry_t> & entries = this->log->get_entries();
 
-			/* resend entries starting at p->next_idx */
-			if (this->log->get_entries().size() > 1) {
-				push_append_entries(p, p->next_idx);
-				handle_write_to_peer(p);
+		for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+			if (LOG_DATA_IS_CONF(it->data)) {
+				this->conf_idx = it->index;
+				apply_members(it->data.substr(sizeof(LOG_CONF_PREFIX) - 1));
+				return;
 			}
 		}
+
+		this->conf_idx = 0;
+		apply_members(this->boot_members);
 	}
 
-	void whale_server::send_append_entries() {
-		log_entry_t & last = this->log->get_last_log();
+	/*
+	* make @members the active configuration: new servers are connected
+	* to, dropped ones disconnected and not reconnected any more.
+	*/
+	void whale_server::apply_members(const std::string & members) {
+		std::vector<w_addr_t> v, l;
+
+		if (parse_members(members, this->listen_port, v, l) != WHALE_GOOD) {
+			log_error("invalid configuration \"%s\", ignored", members.c_str());
+			return;
+		}
+
+		this->self_member = this->self_learner = false;
+
+		for (w_addr_t & a : v)
+			admit_member(a, false);
+		for (w_addr_t & a : l)
+			admit_member(a, true);
 
-		/**
-		* If last log index ≥ nextIndex for a follower: send
-		* AppendEntries RPC with log entries starting at nextIndex
-		*/
 		for (auto & it : this->servers) {
-			if (it.second.next_idx < last.index) {
-				push_append_entries(&it.second, it.second.next_idx);
-				handle_write_to_peer(&it.second);
-			}
+			if (it.second.member && !has_member(v, it.second.addr) &&
+			    !has_member(l, it.second.addr))
+				drop_server(&it.second);
 		}
 	}
 
-	void whale_server::process_cmd_request(peer_t * p) {
-		p->cur_cmd = p->c_queue.front();
-		p->c_queue.pop();
+	/*
+	* @a is in the configuration, as a learner if @learner.
+	*/
+	void whale_server::admit_member(w_addr_t & a, bool learner) {
+		if (is_self(a)) {
+			this->self_member = true;
+			this->self_learner = learner;
+			return;
+		}
 
-		/* redirect client to real leader */
-		if (this->state != LEADER) {
-			p->cur_cmd.reset();
-			reply_redirect_to_client(p);
+		auto it = this->servers.find(a);
+
+		if (it == this->servers.end()) {
+			peer_t peer = INIT_PEER;
+
+			peer.addr = a;
+			peer.server = this;
+			peer.next_idx = this->log->get_last_log().index + 1;
+
+			register_conn(&this->peers.insert(
+			                  std::pair<w_addr_t, peer_t>(a, peer)).first->second);
+			it = this->servers.insert(std::pair<w_addr_t, peer_t>(a, peer)).first;
+			register_conn(&it->second);
+		}
 
+		if (it->second.member) {
+			if (it->second.learner != learner)
+				log_error("%s is a %s now", a.name.c_str(),
+				          learner ? "learner" : "voter");
+			it->second.learner = learner;
 			return;
 		}
 
-		log_entry_t &e = this->log->get_last_log();
-		
-		this->log->get_entries().push_back({e.index + 1, 
-			                                get_fmapped()->current_term, 
-			                                p->cur_cmd->cmd});
+		log_error("%s joins the cluster as a %s", a.name.c_str(),
+		          learner ? "learner" : "voter");
+
+		/* whatever it had before it left, find out again */
+		it->second.match_idx = 0;
+		it->second.next_idx = this->log->get_last_log().index + 1;
+		it->second.probing = true;
+
 		/*
-		* for future reply to client.
+		* internal peer connection,
+		* must be scheduled for reconnecting after connection closed.
 		*/
-		p->cur_cmd->index = e.index + 1;
-		p->cur_cmd->term = get_fmapped()->current_term;
+		it->second.member = true;
+		it->second.learner = learner;
+		it->second.need_to_reconnect = true;
+		connect_to_server(&it->second);
+	}
 
-		send_append_entries();
+	/*
+	* @p left the configuration. The entry stays in @servers and @peers,
+	* it may come back, but we stop talking to it.
+	*/
+	void whale_server::drop_server(peer_t * p) {
+		log_error("%s leaves the cluster", p->addr.name.c_str());
+
+		p->member = false;
+		p->learner = false;
+		p->need_to_reconnect = false;
+		this->timers.cancel(&p->reconnect_timer);
+
+		if (p == this->transferee)
+			end_transfer();
+
+		if (p->connected) {
+			peer_cleanup(p);
+		} else if (event_in_reactor(&p->connect_e)) {
+			reactor_remove_event(&this->r, &p->connect_e);
+			TEMP_FAILURE_RETRY(close(p->connect_e.fd));
+		}
+	}
+
+	/* ourselves as listed in configurations, with the peer port */
+	std::string whale_server::self_member_name() {
+		w_addr_t a = this->self;
+
+		a.addr.sin_port = ::htons(this->listen_port);
+		return w_addr_to_string(a);
 	}
 
 	/*
-	* handles fully read messages from peer's read_queue.
+	* voters and learners of the active configuration, ourselves included.
 	*/
-	void whale_server::process_messages(peer_t * p) {
-		msg_queue & q = p->read_queue;
-		while (!q.empty()) {
-			msg_q_elt & elt = q.front();
+	void whale_server::current_members(std::vector<w_addr_t> & v,
+	                                   std::vector<w_addr_t> & l) {
+		w_addr_t me = this->self;
 
-			/* process complete message only */
-			if (elt.pin < ::htonl(elt.msg->len))
-				break;
+		me.addr.sin_port = ::htons(this->listen_port);
 
-			switch (::htonl(elt.msg->msg_type)) {
-			case MESSAGE_REQUEST_VOTE:
-				process_request_vote(p, elt.msg);
-				break;
-			case MESSAGE_REQUEST_VOTE_RES:
-				process_request_vote_res(p, elt.msg);
-				break;
-			case MESSAGE_APPEND_ENTRIES:
-				process_append_entries(p, elt.msg);
-				break;
-			case MESSAGE_APPEND_ENTRIES_RES:
-				process_append_entries_res(p, elt.msg);
-				break;
-			case MESSAGE_CMD_REQUEST:
-				p->c_queue.push(cmd_sptr{make_cmd_request_from_msg(*elt.msg.get())});
-				if (p->cur_cmd.get() == nullptr) {
-					process_cmd_request(p);
-				}
-				break;
-			}
+		if (this->self_member)
+			(this->self_learner ? l : v).push_back(me);
 
-			q.pop();
+		for (auto & it : this->servers) {
+			if (it.second.member)
+				(it.second.learner ? l : v).push_back(it.second.addr);
 		}
 	}
 
-	/* 
-	* read as many as messages from peer until ::read() returns EAGAIN,
-	* and start processing messages.
+	/*
+	* the members a config file asks for: ourselves and the peers line
+	* as voters, unless listed by the learners line.
+	* Return: WHALE_GOOD on success, WHALE_CONF_ERROR on failure.
 	*/
-	void whale_server::handle_read_from_peer(peer_t * p) {
-		el_socket_t fd = p->e.fd;
-		int32_t     nread = 0;
-		uint32_t    size;
-		msg_q_elt  *elt;
+	w_rc_t whale_server::members_from_config(config * c, std::string & out) {
+		std::vector<w_addr_t> v, l, none;
+		w_addr_t              me = this->self;
 
-		/* 
-		* special case for empty queue
-		*/
-		if (p->read_queue.empty()) {
-			p->read_queue.push({0, 0, msg_sptr()});
+		if (c->get("peers") == nullptr) {
+			log_error("peers is required");
+			return WHALE_CONF_ERROR;
 		}
 
-	again:
-		elt = &p->read_queue.back();
-
-		/* 
-		* read the length of the incoming message, 
-		* and construct a message with size of @elt->tmp_len.
-		*/
-		if (elt->msg.use_count() == 0) {
-
-			while (elt->pin < sizeof(uint32_t)) {
-				nread = ::read(fd, ((char *)&elt->tmp_len) + elt->pin,
-				               sizeof(uint32_t));
-
-				if (nread <= 0) {
-					if (nread == 0) { /* peer closed connection */
-						peer_cleanup(p);
-						return;
-					} else if (errno == EINTR) {/* retry */
-						continue;
-					} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-						goto process_messages_;
-					}
-					/* error occured */
-					log_error("error occured during ::read() from fd[%d]: %s",
-						      fd, ::strerror(errno));
-					::abort();
-				}
-				elt->pin += nread;
-			}
-			/* got the length for @elt->msg */
+		if (parse_members(*c->get("peers"), this->listen_port, v, l) != WHALE_GOOD)
+			return WHALE_CONF_ERROR;
 
-			elt->msg = msg_sptr(reinterpret_cast<message_t *>(
-				                new char[::htonl(elt->tmp_len)]));
+		if (c->get("learners") != nullptr &&
+		    parse_members(*c->get("learners"), this->listen_port,
+		                  l, none) != WHALE_GOOD)
+			return WHALE_CONF_ERROR;
 
-			if (elt->msg.use_count() == 0) {
-				/* memory shortage, retry later*/
-				log_error("failed to allocate %d bytes for message",
-						  ::htonl(elt->tmp_len));
-				goto process_messages_;
-			}
+		me.addr.sin_port = ::htons(this->listen_port);
 
-			elt->pin = 0;
-		}
+		if (!has_member(l, me) && !has_member(v, me))
+			v.insert(v.begin(), me);
 
-		size = MESSAGE_SIZE(elt->msg);
+		out = format_members(v, l);
+		return WHALE_GOOD;
+	}
 
-		while (elt->pin < size) {
-			nread = ::read(fd, elt->msg.get() + elt->pin, size - elt->pin);
+	/*
+	* SIGHUP: the leader re-reads the peers and learners lines of the
+	* config file and moves the cluster to them.
+	*/
+	void whale_server::handle_conf_signal() {
+		config c(this->cfg_file);
 
-			if (nread <= 0) {
-				if (nread == 0) { /* peer closed connection */
-					peer_cleanup(p);
-					return;
-				} else if (errno == EINTR) { /* retry */
-					continue;
-				} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-					goto process_messages_;
-				}
-				/* error occured */
-				log_error("error occured during ::read() from fd[%d]: %s",
-					      fd, ::strerror(errno));
-				::abort();
-			}
-			elt->pin += nread;
+		if (this->state != LEADER) {
+			log_error("membership changes go through the leader, ignored");
+		} else if (c.parse() != WHALE_GOOD ||
+		           members_from_config(&c, this->conf_target) != WHALE_GOOD) {
+			log_error("failed to read members from %s", this->cfg_file.c_str());
+			this->conf_target.clear();
+		} else {
+			change_membership();
 		}
 
-		/* successfully read an entire message, create a new one for the next*/
-		p->read_queue.push({0, 0, msg_sptr()});
-
-		goto again;
-
-	process_messages_:
-		process_messages(p);
+		/* in case the reactor fires signal events only once */
+		if (!event_in_reactor(&this->conf_event) &&
+		    reactor_add_event(&this->r, &this->conf_event) == -1)
+			log_error("failed to reactor_add_event for SIGHUP: %s",
+			          ::strerror(errno));
 	}
-	
 
-	inline void 
-	whale_server::remove_event_if_in_reactor(struct event * e) {
-		if (event_in_reactor(e))
-			reactor_remove_event(&this->r, e);
+	/*
+	* run change_membership() on the next tick, we may be in the middle
+	* of handling a peer it is going to disconnect.
+	*/
+	void whale_server::schedule_membership_change() {
+		if (!this->conf_target.empty() && this->conf_idx <= this->commit_index &&
+		    this->noop_idx <= this->commit_index &&
+		    !timer_wheel::armed(&this->conf_timer))
+			this->timers.add(&this->conf_timer, 0, conf_change_callback, this);
 	}
 
-	void whale_server::reset_reconnect_timer(peer_t * p) {
-		/* 
-		*  connect is in progress or peer is not online,
-		*  setup a timer to reconnect after a period of time.
-		*/
-		struct event * timeout_e = &p->timeout_e;
+	/*
+	* take one step toward @conf_target, as a configuration entry in the
+	* log. Any two majorities of configurations one voter apart overlap,
+	* so the next step waits for this one to commit only. In order:
+	*     1. new servers join as learners, they don't count for commits
+	*        while catching up.
+	*     2. learners that are to vote get promoted once caught up.
+	*     3. voters that are to learn get demoted.
+	*     4. servers not wanted any more are removed.
+	*/
+	void whale_server::change_membership() {
+		std::vector<w_addr_t> v, l, cv, cl;
+		bool                  changed = false, waiting = false;
+		w_int_t               last = this->log->get_last_log().index;
 
-		remove_event_if_in_reactor(timeout_e);
+		/*
+		* a configuration entry of an earlier term may still be overwritten
+		* by one we can't see, wait for an entry of our own term as well.
+		*/
+		if (this->state != LEADER || this->conf_target.empty() ||
+		    this->conf_idx > this->commit_index ||
+		    this->noop_idx > this->commit_index)
+			return;
 
-		event_set(timeout_e, WHALE_RECONNECT_TIMEOUT, E_TIMEOUT,
-		          peer_reconnect_callback, p);
+		if (parse_members(this->conf_target, this->listen_port, v, l) != WHALE_GOOD) {
+			this->conf_target.clear();
+			return;
+		}
 
-		if (reactor_add_event(&this->r, timeout_e) == -1)
-		    log_error("failed to reactor_add_event for"
-		              " reconnecting timeer event: %s", ::strerror(errno));
-	}
+		current_members(cv, cl);
 
-	void whale_server::peer_cleanup(peer_t * p) {
-		p->connected = false;
-		msg_queue().swap(p->read_queue);
-		msg_queue().swap(p->write_queue);
-		remove_event_if_in_reactor(&p->e);
-		if (p->need_to_reconnect)
-			reset_reconnect_timer(p);
+		for (size_t i = 0; i < v.size() + l.size() && !changed; ++i) {
+			w_addr_t & a = i < v.size() ? v[i] : l[i - v.size()];
 
-		TEMP_FAILURE_RETRY(close(p->e.fd));
-	}
+			if (!is_self(a) && !has_member(cv, a) && !has_member(cl, a)) {
+				cl.push_back(a);
+				changed = true;
+			}
+		}
 
-	/*
-	* write as many as messages to peer until ::write() returns EAGAIN.
-	*/
-	void whale_server::handle_write_to_peer(peer_t * p) {
-		el_socket_t fd = p->e.fd;
+		for (size_t i = 0; i < v.size() && !changed; ++i) {
+			auto it = this->servers.find(v[i]);
 
-		while (!p->write_queue.empty()) {
-			msg_q_elt & elt = p->write_queue.front();
-			uint32_t    size = MESSAGE_SIZE(elt.msg);
-			int32_t     nwrite = 0;
+			if (is_self(v[i]) || !has_member(cl, v[i]))
+				continue;
 
-			if (size == elt.pin) {
-				p->write_queue.pop();
+			if (!it->second.connected ||
+			    it->second.match_idx + WHALE_LEARNER_LAG < last) {
+				waiting = true;
 				continue;
 			}
 
-			while (elt.pin < size) {
-				nwrite = ::write(fd, elt.msg.get() + elt.pin, size - elt.pin);
-
-				if(nwrite == -1) {
-					/* socket buffer might not have enough available space */
-					if (errno == EAGAIN || errno == EWOULDBLOCK) {
-						break;
-					} else if (errno == EINTR) { /* retry */
-						continue;
-					} else if (errno == EPIPE) { /* peer closed connection */
-						peer_cleanup(p);
-						return;
-					}
-					
-					/* error occured */
-					log_error("error occured during ::write() to fd[%d]: %s",
-						      fd, ::strerror(errno));
-					::abort();
-				}
+			remove_member(cl, v[i]);
+			cv.push_back(v[i]);
+			changed = true;
+		}
 
-				elt.pin += nwrite;
+		for (size_t i = 0; i < l.size() && !changed; ++i) {
+			if (!is_self(l[i]) && has_member(cv, l[i])) {
+				remove_member(cv, l[i]);
+				cl.push_back(l[i]);
+				changed = true;
 			}
 		}
-	}
 
-	/*
-	* reset this local's election timer event.
-	*/
-	void whale_server::reset_elec_timeout_event() {
-		if (event_in_reactor(&this->elec_timeout_event) &&
-			reactor_remove_event(&this->r, &this->elec_timeout_event))
-			log_error("failed to reactor_remove_event"
-			          " election timeout event: %s", ::strerror(errno));
+		for (auto & it : this->servers) {
+			if (changed || !it.second.member ||
+			    has_member(v, it.second.addr) || has_member(l, it.second.addr))
+				continue;
 
-		/* start timer event with a random period of time for election*/
-		event_set(&this->elec_timeout_event,
-		          NEXT_TIMEOUT(WHALE_MIN_ELEC_TIMEOUT, WHALE_MAX_ELEC_TIMEOUT),
-		          E_TIMEOUT, elec_timeout_callback, this);
+			remove_member(cv, it.second.addr);
+			remove_member(cl, it.second.addr);
+			changed = true;
+		}
 
-		if (reactor_add_event(&this->r, &this->elec_timeout_event) == -1)
-			log_error("failed to reactor_add_event for"
-			          " election timeout event: %s", ::strerror(errno));
+		/* learners catching up, their replies bring us back here */
+		if (!changed) {
+			if (!waiting) {
+				log_error("membership is up to date: %s",
+				          format_members(cv, cl).c_str());
+				this->conf_target.clear();
+			}
+			return;
+		}
+
+		std::string next = format_members(cv, cl);
+
+		this->log->get_entries().push_back({(int32_t)last + 1,
+		                                    (int32_t)this->meta->term(),
+		                                    LOG_CONF_PREFIX + next});
+		this->conf_idx = last + 1;
+		apply_members(next);
+
+		send_append_entries();
 	}
 
 	/*
-	* election timeout elapsed, starts a new election.
+	* starts a new election.
 	*/
-	void whale_server::turn_into_candidate() {
+	void whale_server::turn_into_candidate(bool transfer) {
 		/*
-		* convert to candidate, set voteFor to null, increment current term.
+		* convert to candidate, vote for self, increment current term.
 		*/
 		this->state = CANDIDATE;
-		::memset(&get_fmapped()->voted_for, 0, sizeof(struct sockaddr_in));
-		this->get_fmapped()->current_term++;
-		this->map->sync();
+		fail_forwarding();
+		this->cur_leader = nullptr;
+		this->meta->set_term(this->meta->term() + 1);
+		this->meta->set_vote(this->self.addr);
 		this->vote_count = 1; /* vote for self */
 		/*
 		* reset elcetion timer in case of collision.
 		*/
 		this->reset_elec_timeout_event();
 
+		/* one sync for both the new term and the vote for self */
+		if (this->meta->sync() != WHALE_GOOD)
+			return;
+
 		/*
 		* broadcasts request vote messages to to connected servers.
 		*/
 		request_vote_t rv;
 
-		rv.term = this->get_fmapped()->current_term;
+		rv.term = this->meta->term();
 		rv.candidate_id = this->self;
 		rv.last_log_idx = this->log->get_last_log().index;
 		rv.last_log_term = this->log->get_last_log().term;
+		/* peers keep their own tables, the id is shared by all of them */
+		rv.rpc_id = ++this->rpc_seq;
+		rv.pre_vote = false;
+		rv.transfer = transfer;
 
 		/* make a generic message out of request vote struct */
 		msg_sptr p = msg_sptr(make_msg_from_request_vote(rv));
 
 		for (auto & it : this->servers) {
 			if (!it.second.connected) continue;
-			it.second.write_queue.push({0, 0, p});
+			track_rpc(&it.second, rv.rpc_id, MESSAGE_REQUEST_VOTE);
+			queue_control(&it.second, p);
 			handle_write_to_peer(&it.second);
-			it.second.request_queue.push({MESSAGE_REQUEST_VOTE, new msg_sptr{p}});
 		}
 	}
 
@@ -981,69 +3318,119 @@ namespace whale {
 			return;
 		}
 
-		/* update hostname */
-		it->second.addr.name = get_peer_hostname(addr);
-
-		remove_event_if_in_reactor(&it->second.e);
+		if (set_fd_nonblocking(peer_fd) != WHALE_GOOD) {
+			TEMP_FAILURE_RETRY(close(peer_fd));
+			return;
+		}
 
-		event_set(&it->second.e, peer_fd, E_READ | E_WRITE,
-		          peer_callback, &it->second);
+		/* update name */
+		it->second.addr.name = w_addr_to_string(addr);
 
-		if (reactor_add_event(&this->r, &it->second.e) == -1)
-			log_error("failed to reactor_add_event for peer %s, fd[%d]: %s",
-			          it->second.addr.name.c_str(), peer_fd, strerror(errno));
+		register_peer_event(&it->second, peer_fd);
 	}
 
 	/*
-	* accepts client connections.
+	* accepts client connections, all that are pending.
 	*/
 	void whale_server::handle_serving_listen_fd() {
-		w_addr_t    addr;
-		el_socket_t peer_fd;
-		socklen_t   sock_len = sizeof(struct sockaddr_in);
+		accept_all(this->serving_fd, [this](el_socket_t fd, w_addr_t & addr) {
+			add_client(fd, addr);
+		});
+	}
+
+	/*
+	* clients accepted by acceptor threads.
+	*/
+	void whale_server::handle_accepted() {
+		accepted_conn_t c;
+
+		wake_consume(&this->accept_wake);
+
+		while (this->accepted.pop(c))
+			add_client(c.fd, c.addr);
+	}
+
+	/*
+	* start serving client socket @fd, already nonblocking.
+	*/
+	void whale_server::add_client(el_socket_t peer_fd, w_addr_t & addr) {
 		peer_it     it;
 
-		peer_fd = ::accept(listen_fd, (struct sockaddr*)&addr.addr,
-		                   &sock_len);
+		addr.name = w_addr_to_string(addr);
 
-		if (peer_fd == -1) {
-			log_error("failed to ::accept client connection: %s",
-				      ::strerror(errno));
-			return;
+		/* forget a previous connection that used the same address */
+		auto old = this->clients.find(addr);
+
+		if (old != this->clients.end()) {
+			/* a close we asked for isn't reported back, forget it now */
+			if (old->second.worker != -1) {
+				this->workers[old->second.worker]->post({WORKER_CMD_CLOSE,
+				                                         old->second.conn_id,
+				                                         -1, {}});
+				this->worker_conns.erase(old->second.conn_id);
+			}
+			this->timers.cancel(&old->second.deadline);
+			this->conn_peers.erase(old->second.conn_id);
+			this->clients.erase(old);
 		}
-		addr.name = get_peer_hostname(addr);
-		
+
 		this->clients.insert(std::pair<w_addr_t, peer_t>(addr, INIT_PEER));
 
 		it = this->clients.find(addr);
+		register_conn(&it->second);
 
 		/* client connection, no need to reconnect */
 		it->second.need_to_reconnect = false;
-		/* update hostname */
+		it->second.server = this;
 		it->second.addr = addr;
 
-		event_set(&it->second.e, peer_fd, E_READ | E_WRITE, peer_callback, &it->second);
+		/* hand the socket over to a worker, replies go through it too */
+		if (!this->workers.empty()) {
+			it->second.worker = this->next_worker++ % this->workers.size();
+			this->worker_conns[it->second.conn_id] = addr;
+			this->workers[it->second.worker]->post({WORKER_CMD_ADD,
+			                                        it->second.conn_id,
+			                                        peer_fd, {}});
+			return;
+		}
+
+		register_peer_event(&it->second, peer_fd);
+	}
 
-		if (reactor_add_event(&this->r, &it->second.e) == -1)
-			log_error("failed to reactor_add_event for client %s, fd[%d]: %s",
-			          it->second.addr.name.c_str(), peer_fd, strerror(errno));
+	/*
+	* give @p, just put into one of the maps, its conn_id.
+	*/
+	void whale_server::register_conn(peer_t * p) {
+		p->conn_id = ++this->conn_seq;
+		this->conn_peers[p->conn_id] = p;
 	}
 
-	void
-	whale_server::connect_to_servers() {
-		for(auto & it : this->servers) {
+	/*
+	* Return: the entry of @conn_id if it still exists and is on the
+	*         connection @conn_gen, nullptr otherwise.
+	*/
+	peer_t * whale_server::find_conn(w_uint_t conn_id, w_uint_t conn_gen) {
+		auto it = this->conn_peers.find(conn_id);
+
+		if (it == this->conn_peers.end() ||
+		    it->second->conn_gen != conn_gen)
+			return nullptr;
+
+		return it->second;
+	}
 
-			if(it.second.connected) continue;
+	void whale_server::connect_to_server(peer_t * p) {
+		el_socket_t fd;
 
-			el_socket_t fd;
+		if (p->connected)
+			return;
 
-			fd = connect_to_peer(it.second);
+		fd = connect_to_peer(*p);
 
-			if (fd >= 0) {
-				set_up_peer_events(&it.second, fd);
-			} else {
-				reset_reconnect_timer(&it.second);
-			}
+		if (fd >= 0) {
+			set_up_peer_events(p, fd);
+		} else {
+			reset_reconnect_timer(p);
 		}
 	}
 
@@ -1066,12 +3453,9 @@ namespace whale {
 			return WHALE_CONF_ERROR;
 		}
 
-		map = std::unique_ptr<file_mmap>(new file_mmap(*map_file, 
-		                                               sizeof(file_mapped_t),
-		                                               MAP_FILE_PROT,
-		                                               MAP_FILE_FLAGS));
-		
-		rc = map->map();
+		meta = std::unique_ptr<meta_store>(new meta_store(*map_file));
+
+		rc = meta->load();
 
 		if (rc != WHALE_GOOD)
 			return rc;
@@ -1104,6 +3488,7 @@ namespace whale {
 			return WHALE_CONF_ERROR;
 		}
 
+		this->self.addr.sin_family = AF_INET;
 		this->self.addr.sin_addr.s_addr = inet_addr(s_listen_ip->c_str());
 		/* end of listen_ip */
 
@@ -1121,7 +3506,7 @@ namespace whale {
 		}
 		/* end of listen_port */
 
-		this->self.name = get_peer_hostname(this->self);
+		this->self.name = w_addr_to_string(this->self);
 
 
 		/* serving_port */
@@ -1139,71 +3524,197 @@ namespace whale {
 		}
 		/* serving_port */
 
-		/* peers */
-		char *p;
-		char *save_ptr;
-		if (cfg->get("peers") == nullptr) {
-			log_error("peers is required");
-			return WHALE_CONF_ERROR;
+		/* edge_triggered */
+		std::string * s_edge = cfg->get("edge_triggered");
+
+		if (s_edge != nullptr && *s_edge == "on") {
+#ifdef E_EDGE
+			this->edge_triggered = true;
+#else
+			log_error("edge_triggered: not supported by the reactor, ignored");
+#endif
 		}
+		/* end of edge_triggered */
 
-		std::unique_ptr<char[]> peer_ips = std::unique_ptr<char[]>(
-			                               new char[cfg->get("peers")->size() + 1]);
-		::strcpy(peer_ips.get(), cfg->get("peers")->c_str());
+		/* forward_to_leader */
+		std::string * s_forward = cfg->get("forward_to_leader");
 
-		p = ::strtok_r(peer_ips.get(), " ", &save_ptr);
+		this->forward_to_leader = s_forward != nullptr && *s_forward == "on";
+		::memset(&this->forward_event, 0, sizeof(struct event));
+		/* end of forward_to_leader */
 
-		while (p) {
-			char   *port_p;
-			int     port;
+		/* pre_vote */
+		std::string * s_pre_vote = cfg->get("pre_vote");
 
-			if (!is_ip(p)) {
-				log_error("invalid peer ip: %s", p);
-				return WHALE_CONF_ERROR;
-			}
+		if (s_pre_vote != nullptr)
+			this->pre_vote = *s_pre_vote == "on";
+		/* end of pre_vote */
 
-			peer_t peer = INIT_PEER;
+		/* check_quorum */
+		std::string * s_check_quorum = cfg->get("check_quorum");
 
-			/*
-			* internal peer connection,
-			* must be scheduled for reconnecting after connection closed.
-			*/
-			peer.need_to_reconnect = true;
+		if (s_check_quorum != nullptr)
+			this->check_quorum = *s_check_quorum == "on";
+		/* end of check_quorum */
 
-			port_p = strchr(p, ':');
+		/* read_lease */
+		std::string * s_read_lease = cfg->get("read_lease");
+		std::string * s_lease_drift = cfg->get("lease_drift");
 
-			if (port_p)
-				::sscanf(port_p + 1, "%d", &port);
-			else
-				port = listen_port;
+		this->read_lease = s_read_lease != nullptr && *s_read_lease == "on";
 
-			if (port > 65535 || port < 0) {
-				log_error("peer's port out of range[0-65535]");
-				return WHALE_CONF_ERROR;
-			}
+		if (s_lease_drift != nullptr)
+			this->lease_drift = std::stoi(*s_lease_drift);
 
-			/* convert to network byte order */
-			peer.addr.addr.sin_port = ::htons(port);
+		if (this->lease_drift < 0 || this->lease_drift >= WHALE_MIN_ELEC_TIMEOUT) {
+			log_error("lease_drift out of range[0-%d)", WHALE_MIN_ELEC_TIMEOUT);
+			return WHALE_CONF_ERROR;
+		}
+		/* end of read_lease */
 
-			peer.addr.addr.sin_addr.s_addr = ::inet_addr(p);
+		/* follower_reads */
+		std::string * s_follower_reads = cfg->get("follower_reads");
 
-			peer.addr.addr.sin_family = AF_INET;
+		this->follower_reads = s_follower_reads != nullptr &&
+		                       *s_follower_reads == "on";
+		::memset(&this->read_index_event, 0, sizeof(struct event));
+		/* end of follower_reads */
 
-			peer.server = this;
+		/* transfer_to */
+		std::string * s_transfer_to = cfg->get("transfer_to");
 
-			peer.addr.name = get_peer_hostname(peer.addr);
+		if (s_transfer_to != nullptr)
+			this->transfer_to = *s_transfer_to;
 
-			this->peers.insert(std::pair<w_addr_t, peer_t>(peer.addr, peer));
+		::memset(&this->transfer_timer, 0, sizeof(w_timer_t));
+		::memset(&this->conf_timer, 0, sizeof(w_timer_t));
+		/* end of transfer_to */
 
-			this->servers.insert(std::pair<w_addr_t, peer_t>(peer.addr, peer));
+		/* peers and learners, the cluster we start out with */
+		rc = members_from_config(cfg.get(), this->boot_members);
 
-			p = ::strtok_r(NULL, " ", &save_ptr);
-		}
-		/* end of peers */
+		if (rc != WHALE_GOOD)
+			return rc;
+		/* end of peers and learners */
 
 		/* fire the reactor up */
 		reactor_init_with_signal_timer(&r, NULL);
 
+		/* every timer hangs off the wheel, the reactor only turns it */
+		::memset(&this->elec_timer, 0, sizeof(w_timer_t));
+		::memset(&this->hb_timer, 0, sizeof(w_timer_t));
+		::memset(&this->quorum_timer, 0, sizeof(w_timer_t));
+		::memset(&this->stats_timer, 0, sizeof(w_timer_t));
+		::memset(&this->tick_event, 0, sizeof(struct event));
+		event_set(&this->tick_event, WHALE_TIMER_TICK, E_TIMEOUT,
+		          tick_callback, this);
+
+		if (reactor_add_event(&this->r, &this->tick_event) == -1) {
+			log_error("failed to reactor_add_event for tick event: %s",
+			          ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		::memset(&this->conf_event, 0, sizeof(struct event));
+		event_set(&this->conf_event, SIGHUP, E_SIGNAL,
+		          conf_signal_callback, this);
+
+		if (reactor_add_event(&this->r, &this->conf_event) == -1) {
+			log_error("failed to reactor_add_event for SIGHUP: %s",
+			          ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		::memset(&this->transfer_event, 0, sizeof(struct event));
+		event_set(&this->transfer_event, SIGUSR1, E_SIGNAL,
+		          transfer_signal_callback, this);
+
+		if (reactor_add_event(&this->r, &this->transfer_event) == -1) {
+			log_error("failed to reactor_add_event for SIGUSR1: %s",
+			          ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		/* backlog */
+		std::string * s_backlog = cfg->get("backlog");
+
+		if (s_backlog != nullptr)
+			this->backlog = std::stoi(*s_backlog);
+
+		if (this->backlog <= 0) {
+			log_error("backlog must be positive");
+			return WHALE_CONF_ERROR;
+		}
+		/* end of backlog */
+
+		/* socket options */
+		if (parse_sock_opts(cfg.get(), "peer_", &this->peer_opts) != WHALE_GOOD ||
+		    parse_sock_opts(cfg.get(), "client_", &this->client_opts) != WHALE_GOOD)
+			return WHALE_CONF_ERROR;
+		/* end of socket options */
+
+		/* peer flow control */
+		std::string * s_max_bytes = cfg->get("peer_max_bytes");
+		std::string * s_max_inflight = cfg->get("peer_max_inflight");
+		std::string * s_stats = cfg->get("peer_stats_interval");
+
+		if (s_max_bytes != nullptr)
+			this->peer_max_bytes = std::stoul(*s_max_bytes);
+		if (s_max_inflight != nullptr)
+			this->peer_max_inflight = std::stoul(*s_max_inflight);
+		if (s_stats != nullptr)
+			this->peer_stats_interval = std::stoi(*s_stats);
+
+		if (this->peer_max_bytes == 0 || this->peer_max_inflight == 0) {
+			log_error("peer_max_bytes and peer_max_inflight must be positive");
+			return WHALE_CONF_ERROR;
+		}
+
+		if (this->peer_stats_interval > 0)
+			this->timers.add(&this->stats_timer, this->peer_stats_interval,
+			                 peer_stats_callback, this);
+		/* end of peer flow control */
+
+		/* client_timeout */
+		std::string * s_client_timeout = cfg->get("client_timeout");
+
+		if (s_client_timeout != nullptr)
+			this->client_timeout = std::stoi(*s_client_timeout);
+		/* end of client_timeout */
+
+		/* rpc_timeout */
+		std::string * s_rpc_timeout = cfg->get("rpc_timeout");
+
+		if (s_rpc_timeout != nullptr)
+			this->rpc_timeout = std::stoi(*s_rpc_timeout);
+
+		if (this->rpc_timeout <= 0) {
+			log_error("rpc_timeout must be positive");
+			return WHALE_CONF_ERROR;
+		}
+		/* end of rpc_timeout */
+
+		/* io_workers */
+		std::string * s_workers = cfg->get("io_workers");
+
+		if (s_workers != nullptr && std::stoi(*s_workers) > 0 &&
+		    start_workers(std::stoi(*s_workers)) != WHALE_GOOD)
+			return WHALE_ERROR;
+		/* end of io_workers */
+
+		/* io_engine */
+		std::string * s_engine = cfg->get("io_engine");
+
+		if (s_engine != nullptr && *s_engine == "uring") {
+#ifdef WHALE_HAVE_IO_URING
+			if (init_uring() != WHALE_GOOD)
+				log_error("io_engine: io_uring unavailable, using the reactor");
+#else
+			log_error("io_engine: built without io_uring, using the reactor");
+#endif
+		}
+		/* end of io_engine */
+
 		/* start listening event for peer connection */
 		w_addr_t    server_addr;
 
@@ -1212,7 +3723,8 @@ namespace whale {
 		server_addr.addr.sin_addr.s_addr = ::htonl(INADDR_ANY);
 		server_addr.addr.sin_port = ::htons(listen_port);
 
-		if ((this->listen_fd = make_listen_fd(&server_addr)) == -1) {
+		if ((this->listen_fd = make_listen_fd(&server_addr, this->backlog,
+		                                      this->peer_opts)) == -1) {
 			log_error("failed to make_listen_fd: %s", ::strerror(errno));
 			return WHALE_ERROR;
 		}
@@ -1234,24 +3746,37 @@ namespace whale {
 		serving_addr.addr.sin_addr.s_addr = ::htonl(INADDR_ANY);
 		serving_addr.addr.sin_port = ::htons(serving_port);
 
-		if ((this->serving_fd = make_listen_fd(&serving_addr)) == -1) {
-			log_error("failed to make_listen_fd: %s", ::strerror(errno));
-			return WHALE_ERROR;
-		}
+		/* serving_acceptors */
+		std::string * s_acceptors = cfg->get("serving_acceptors");
+
+		if (s_acceptors != nullptr && std::stoi(*s_acceptors) > 0) {
+			if (start_acceptors(std::stoi(*s_acceptors),
+			                    &serving_addr) != WHALE_GOOD)
+				return WHALE_ERROR;
+		} else {
+			if ((this->serving_fd = make_listen_fd(&serving_addr,
+			                                       this->backlog,
+			                                       this->client_opts)) == -1) {
+				log_error("failed to make_listen_fd: %s", ::strerror(errno));
+				return WHALE_ERROR;
+			}
 
-		event_set(&this->serving_event, this->serving_fd, E_READ,
-		          serving_callback, this);
+			event_set(&this->serving_event, this->serving_fd, E_READ,
+			          serving_callback, this);
 
-		if (reactor_add_event(&this->r, &this->serving_event) == -1) {
-			log_error("failed to reactor_add_event for serving_event[%d]: %s",
-			          this->serving_fd, ::strerror(errno));
-			return WHALE_ERROR;
+			if (reactor_add_event(&this->r, &this->serving_event) == -1) {
+				log_error("failed to reactor_add_event for serving_event[%d]: %s",
+				          this->serving_fd, ::strerror(errno));
+				return WHALE_ERROR;
+			}
 		}
+		/* end of serving_acceptors */
 
 		/* don't know who is leader yet */
 		this->cur_leader = nullptr;
 
-		connect_to_servers();
+		/* members by the log, connects to every one of them */
+		load_members();
 		reset_elec_timeout_event();
 
 		return WHALE_GOOD;
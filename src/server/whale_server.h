@@ -4,18 +4,28 @@
 #include <memory>
 #include <random>
 #include <queue>
+#include <deque>
+#include <map>
 #include <cstdlib>
 
 #include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 
 #include <cheetah/reactor.h>
 
 #include <define.h>
 
-#include <file_mmap.h>
+#include <timer_wheel.h>
 #include <whale_log.h>
+#include <whale_meta.h>
+#include <whale_kv.h>
 #include <whale_config.h>
+#include <whale_sockopt.h>
 #include <whale_message.h>
+#include <whale_uring.h>
+#include <whale_worker.h>
+#include <whale_acceptor.h>
 
 namespace whale {
 	class whale_server;
@@ -28,31 +38,39 @@ namespace whale {
 		msg_sptr    msg;
 	}msg_q_elt;
 
-	typedef std::queue<msg_q_elt> msg_queue;
-
-	typedef struct reply_queue_elt_s {
-		/* reuqest message type */
-		w_int_t type;
-		/* holds request that sent to peer */
-		void   *data;
-		~reply_queue_elt_s() {
-			if (type == MESSAGE_REQUEST_VOTE) 
-				delete static_cast<request_vote_t *>(data);
-			else if(type == MESSAGE_APPEND_ENTRIES)
-				delete static_cast<append_entries_t *>(data);
-			else if(type == MESSAGE_CMD_REQUEST)
-				delete static_cast<cmd_request_t *>(data);
-			::abort();
-		}
-	}reply_queue_elt_s;
+	typedef std::deque<msg_q_elt> msg_queue;
+
+	typedef struct peer_s peer_t;
+
+	/*
+	* a request sent to a peer and not answered yet. the reply carries
+	* the request's rpc_id back, so replies may come in any order.
+	*/
+	typedef struct rpc_s {
+		w_uint_t    id;
+		/* MESSAGE_REQUEST_VOTE, MESSAGE_PRE_VOTE or MESSAGE_APPEND_ENTRIES */
+		w_int_t     type;
+		/* our term when it was sent, replies to older terms are stale */
+		w_int_t     term;
+		bool        heartbeat;
+		/* AppendEntries: index of its last entry */
+		w_int_t     last_idx;
+		/* leader's read round when it was sent, a reply confirms it */
+		w_uint_t    read_round;
+		/* ms of the timer wheel when it was sent */
+		uint64_t    sent_at;
+		peer_t     *p;
+		/* forgets the request if no reply comes in time */
+		w_timer_t   timer;
+	} rpc_t;
 
-	typedef std::queue<reply_queue_elt_s> wait_queue;
+	typedef std::map<w_uint_t, rpc_t> rpc_table;
 
 	typedef struct peer_s{
 		w_addr_t 		addr;
 		struct event 	e;
-		/* timeout event to reconnect to peer */
-		struct event    timeout_e;
+		/* timer to reconnect to peer */
+		w_timer_t       reconnect_timer;
 		/* event of connect syscall */
 		struct event    connect_e;
 		w_int_t			next_idx;
@@ -63,53 +81,161 @@ namespace whale {
 		bool            connected;
 		/* should we reset reconnect timer after connection closed ? */
 		bool            need_to_reconnect;
+		/* peer used only: in the active configuration, votes and counts for commits */
+		bool            member;
+		/* peer used only: a member that gets the log but doesn't vote or count */
+		bool            learner;
+		/* is E_WRITE currently registered for @e ? */
+		bool            want_write;
+		/* io_uring only: is a send of @write_queue in flight ? */
+		bool            send_inflight;
+		/* bumped whenever the connection closes */
+		w_uint_t        conn_gen;
+		/* client used only: worker serving the socket, -1 if we do */
+		w_int_t         worker;
+		/* unique to the entry, see whale_server::conn_peers */
+		w_uint_t        conn_id;
+		/* bytes queued to the peer and not written out yet */
+		size_t          queued_bytes;
+		/* leader side: AppendEntries sent and not answered yet */
+		w_uint_t        inflight_ae;
+		/*
+		* leader side: we don't know where the peer's log ends, send
+		* one AppendEntries at a time and move @next_idx on replies only.
+		*/
+		bool            probing;
+		/* leader side: latest read round the peer confirmed our leadership in */
+		w_uint_t        read_ack;
+		/* leader side: send time of the latest request it answered in our term */
+		uint64_t        lease_ack;
+		/* client used only: id of @cur_cmd while forwarded to the leader */
+		w_uint_t        forward_id;
+		/* client used only: fails @cur_cmd if it takes too long */
+		w_timer_t       deadline;
 		/* client used only: is there any previous cmd request to be completed? */
 		cmd_sptr        cur_cmd;
 		/* queued cmd requests sent by client */
 		cmd_queue       c_queue;
-		/* messages read from peer */
-		msg_queue       read_queue;
+		/* receive buffer, bytes in [@rbuf_start, @rbuf_end) are unhandled */
+		std::shared_ptr<char> rbuf;
+		uint32_t        rbuf_start;
+		uint32_t        rbuf_end;
+		/* a message larger than @rbuf being read on its own */
+		msg_q_elt       spill;
 		/* messages to be written to peer */
 		msg_queue       write_queue;
-		/* 
-		* request messages that are wating for replies
-		* in the order of being sent out.
+		/*
+		* control messages (votes, heartbeats, replies), they go out
+		* ahead of @write_queue at its next frame boundary.
 		*/
-		wait_queue      request_queue;
+		msg_queue       ctrl_queue;
+		/* requests that are waiting for replies, by rpc_id */
+		rpc_table       rpcs;
 	} peer_t;
 
 	#define INIT_PEER    {      \
 		.addr =  {{0}, ""},     \
 		.e = {0},               \
-		.timeout_e = {0},       \
+		.reconnect_timer = INIT_TIMER, \
 		.connect_e = {0},       \
 		.next_idx = 0,          \
 		.match_idx = 0,         \
 		.server = 0,            \
 		.connected = 0,         \
-		.need_to_reconnect = 0  \
+		.need_to_reconnect = 0, \
+		.member = 0,            \
+		.learner = 0,           \
+		.want_write = 0,        \
+		.send_inflight = 0,     \
+		.conn_gen = 0,          \
+		.worker = -1,           \
+		.conn_id = 0,           \
+		.queued_bytes = 0,      \
+		.inflight_ae = 0,       \
+		.probing = 1,           \
+		.read_ack = 0,          \
+		.lease_ack = 0,         \
+		.forward_id = 0,        \
+		.deadline = INIT_TIMER, \
+		.rbuf_start = 0,        \
+		.rbuf_end = 0           \
 	}
 
-	/* stuff need to stay persistent on disk*/
-	typedef struct file_mapped_s{
-		int32_t 	       current_term;	/* current term */
-		struct sockaddr_in voted_for;		/* candidate veted for */
-	} file_mapped_t;
+	/* a client command forwarded to us by a follower */
+	typedef struct forwarded_cmd_s {
+		/* follower that forwarded the command */
+		peer_t     *from;
+		/* follower's id for the command */
+		w_uint_t    id;
+		/* where the command went in our log */
+		w_int_t     index;
+		w_int_t     term;
+	} forwarded_cmd_t;
+
+	/* a read a follower serves itself, waiting for the leader's read index */
+	typedef struct remote_read_s {
+		/* follower that asked */
+		peer_t     *from;
+		/* follower's id for the request */
+		w_uint_t    id;
+		w_int_t     index;
+		/* read round that has to confirm it */
+		w_uint_t    round;
+	} remote_read_t;
 
 	#define FOLLOWER	0
 	#define CANDIDATE	1
 	#define LEADER		2
-
-	#define MAP_FILE_PROT 	PROT_WRITE | PROT_READ
-	#define MAP_FILE_FLAGS	MAP_SHARED
+	/* asking peers whether we could win before starting an election */
+	#define PRE_CANDIDATE	3
 
 	#define DEFAULT_LISTEN_PORT     29999
 	#define DEFAULT_SERVING_PORT    29998
-	#define WHALE_BACKLOG           10
+	/* default listen backlog, the backlog option overrides it */
+	#define WHALE_BACKLOG           1024
 	#define WHALE_MIN_ELEC_TIMEOUT  150
 	#define WHALE_MAX_ELEC_TIMEOUT  300
 	#define WHALE_RECONNECT_TIMEOUT 1000
 	#define WHLAE_HEARTBEAT_TIMEOUT 50
+	/* ms between turns of the timer wheel */
+	#define WHALE_TIMER_TICK        5
+	/* default client_timeout, ms a client command may stay unanswered */
+	#define WHALE_CLIENT_TIMEOUT    3000
+	/* entries a learner may lag behind the leader and still be promoted */
+	#define WHALE_LEARNER_LAG       64
+	/* ms a leadership transfer may take before it is given up */
+	#define WHALE_TRANSFER_TIMEOUT  (2 * WHALE_MAX_ELEC_TIMEOUT)
+	/* read index of a follower read the leader hasn't answered yet */
+	#define WHALE_READ_PENDING      INTPTR_MAX
+	/* default lease_drift, ms the clocks of two servers may drift apart in a lease */
+	#define WHALE_LEASE_DRIFT       20
+	/* default rpc_timeout, ms a peer request waits for its reply */
+	#define WHALE_RPC_TIMEOUT       1000
+	/* per connection receive buffer, larger frames get their own */
+	#define WHALE_RECV_BUF          (64 * 1024)
+	/* flow control toward a peer, see the peer_max_* options */
+	#define WHALE_PEER_MAX_BYTES    (4 * 1024 * 1024)
+	#define WHALE_PEER_MAX_INFLIGHT 8
+	/* entries of one AppendEntries take at most this many bytes */
+	#define WHALE_AE_MAX_BYTES      (1024 * 1024)
+	/* frames gathered into one write at most */
+	#define WHALE_WRITE_IOV         64
+	/* forwarded commands per message at most */
+	#define WHALE_FORWARD_BATCH     128
+
+#ifdef WHALE_HAVE_IO_URING
+	/* a sendmsg of a peer's write_queue on its way through the ring */
+	typedef struct uring_send_s {
+		/* the peer is looked up by these, it may be gone on completion */
+		w_uint_t               conn_id;
+		/* its conn_gen when the send was queued */
+		w_uint_t               conn_gen;
+		struct iovec           iov[WHALE_WRITE_IOV];
+		struct msghdr          mh;
+		/* keeps the frames alive until the kernel is done with them */
+		std::vector<msg_sptr>  frames;
+	} uring_send_t;
+#endif
 
 	typedef struct {
 		bool operator()(const w_addr_t &a1, const w_addr_t &a2) {
@@ -117,11 +243,33 @@ namespace whale {
 		}
 	}WADDR_PRED;
 
+	/* clients may share an ip, tell them apart by port too */
+	typedef struct {
+		bool operator()(const w_addr_t &a1, const w_addr_t &a2) {
+			return a1.addr.sin_addr.s_addr < a2.addr.sin_addr.s_addr ||
+			       (a1.addr.sin_addr.s_addr == a2.addr.sin_addr.s_addr &&
+			        a1.addr.sin_port < a2.addr.sin_port);
+		}
+	}WADDR_PORT_PRED;
+
 	class whale_server {
 	public:
 
 		whale_server(std::string file = "whale.conf")
-			:cfg_file(file), state(FOLLOWER), commit_index(0), last_applied(0) {}
+			:cfg_file(file), state(FOLLOWER), commit_index(0), last_applied(0),
+			 listen_fd(-1), serving_fd(-1), vote_count(0), pre_vote(true), check_quorum(true), leader_contact(0),
+			 transferee(nullptr), timeout_now_sent(false), clients_parked(false),
+			 conf_idx(0), self_member(true), self_learner(false),
+			 edge_triggered(false), forward_to_leader(false), forward_seq(0),
+			 next_worker(0), conn_seq(0), backlog(WHALE_BACKLOG),
+			 peer_opts(INIT_SOCK_OPTS), client_opts(INIT_SOCK_OPTS),
+			 peer_max_bytes(WHALE_PEER_MAX_BYTES),
+			 peer_max_inflight(WHALE_PEER_MAX_INFLIGHT),
+			 peer_stats_interval(0), client_timeout(WHALE_CLIENT_TIMEOUT),
+			 rpc_seq(0), rpc_timeout(WHALE_RPC_TIMEOUT), noop_idx(0),
+			 read_round(0), read_confirmed(0), read_wanted(0),
+			 read_lease(false), lease_drift(WHALE_LEASE_DRIFT), lease_from(0),
+			 follower_reads(false), read_index_seq(0), read_index_open(0) {}
 
 		/*
 		* initialize the server.
@@ -137,51 +285,178 @@ namespace whale {
 		void handle_read_from_client(peer_t * p);
 		void handle_write_to_client(peer_t * p);
 
-		void connect_to_servers();
+		void connect_to_server(peer_t * p);
+		void handle_conf_signal();
+		void change_membership();
 		void send_heartbeat();
-		void push_append_entries(peer_t * p, size_t start);
+		size_t push_append_entries(peer_t * p, size_t start);
+		void replicate_to(peer_t * p);
+		void dump_peer_stats();
 		void send_append_entries();
-		void reply_success_to_client(peer_t * client);
+		void reply_success_to_client(peer_t * client, w_int_t index);
 		void reply_redirect_to_client(peer_t * client);
+		void reply_failure_to_client(peer_t * client);
+		void reply_read_to_client(peer_t * client);
+		void start_read(peer_t * client);
+		void follower_read(peer_t * client);
+		void session_read(peer_t * client);
+		void flush_read_index();
+		bool serve_read(peer_t * client);
+		void reply_reads();
+		void redirect_leader_reads();
+		void confirm_reads();
+		void answer_read_indexes();
+		void process_read_index(peer_t * p, msg_sptr msg);
+		void process_read_index_res(peer_t * p, msg_sptr msg);
+		void resolve_follower_reads(w_uint_t id, bool ok, w_int_t index);
+		uint64_t quorum_contact();
+		void update_lease();
+		void reset_quorum_timer();
+		void check_leader_quorum();
+		bool lease_valid();
 		void reply_clients();
 		void leader_adjust_commit_index();
 		void apply_log();
 
-		void process_messages(peer_t * p);
+		void process_message(peer_t * p, msg_sptr msg);
 		void process_request_vote(peer_t * p, msg_sptr msg);
 		void process_request_vote_res(peer_t * p, msg_sptr msg);
 		void process_append_entries(peer_t * p, msg_sptr msg);
 		void process_append_entries_res(peer_t * p, msg_sptr msg);
 		void process_cmd_request(peer_t *p);
+		void process_forward_cmds(peer_t * p, msg_sptr msg);
+		void process_forward_cmds_res(peer_t * p, msg_sptr msg);
+		void forward_cmd_to_leader(peer_t * client);
+		void flush_forward_batch();
+		void fail_forwarding();
+		void reply_forwarded();
 
 		void reset_heartbeat_timer();
 		void reset_elec_timeout_event();
 		void reset_reconnect_timer(peer_t * p);
-		void turn_into_candidate();
+		void arm_client_deadline(peer_t * client);
+		void finish_client_cmd(peer_t * client);
+		void client_timed_out(peer_t * client);
+		void handle_tick();
+		void rpc_timed_out(rpc_t * rpc);
+		void start_pre_vote();
+		w_rc_t transfer_leadership(peer_t * target);
+		void handle_transfer_signal();
+		void abort_transfer();
+		void turn_into_candidate(bool transfer = false);
 		void turn_into_follower(w_int_t term);
 		void claim_leadership();
 		struct reactor * get_reactor() {return &r;};
+		const w_addr_t & get_self() {return self;};
+		const sock_opts_t & get_peer_sock_opts() {return peer_opts;};
 		void remove_event_if_in_reactor(struct event * e);
 		void set_up_peer_events(peer_t * p, el_socket_t fd);
+		void handle_worker_events();
+		void handle_accepted();
+#ifdef WHALE_HAVE_IO_URING
+		void handle_uring_completions();
+		void submit_uring();
+#endif
 	private:
 		void peer_cleanup(peer_t * p);
+		void register_peer_event(peer_t * p, el_socket_t fd);
+		void register_conn(peer_t * p);
+		peer_t * find_conn(w_uint_t conn_id, w_uint_t conn_gen);
+		void update_write_interest(peer_t * p);
+		bool process_rbuf(peer_t * p);
+		void compact_rbuf(peer_t * p);
+		bool read_spill(peer_t * p);
+		void advance_write_queue(peer_t * p, size_t n);
+		void queue_control(peer_t * p, msg_sptr msg);
+		void queue_bulk(peer_t * p, msg_sptr msg);
+		void merge_control(peer_t * p);
+		void track_rpc(peer_t * p, w_uint_t id, w_int_t type,
+		               bool heartbeat = false, w_int_t last_idx = 0);
+		bool complete_rpc(peer_t * p, w_uint_t id, rpc_t * rpc);
+		void forget_append_entries(peer_t * p);
+		void forget_rpcs(peer_t * p);
+		void send_timeout_now(peer_t * p);
+		void process_timeout_now(peer_t * p, msg_sptr msg);
+		void end_transfer();
+		void resume_parked_clients();
+		void load_members();
+		void apply_members(const std::string & members);
+		void admit_member(w_addr_t & a, bool learner);
+		void drop_server(peer_t * p);
+		void current_members(std::vector<w_addr_t> & v, std::vector<w_addr_t> & l);
+		w_rc_t members_from_config(config * c, std::string & out);
+		void schedule_membership_change();
+		std::string self_member_name();
+		bool majority_value(std::vector<uint64_t> & acks, uint64_t self,
+		                    uint64_t & out);
+		bool is_self(const w_addr_t & a) {
+			return a.addr.sin_addr.s_addr == this->self.addr.sin_addr.s_addr;
+		}
+		bool self_voter() {
+			return this->self_member && !this->self_learner;
+		}
+		/* voters of the active configuration, ourselves included */
+		w_uint_t voters() {
+			w_uint_t n = self_voter() ? 1 : 0;
+
+			for (auto & it : this->servers)
+				n += it.second.member && !it.second.learner;
+			return n;
+		}
+		bool has_output(peer_t * p) {
+			return !p->write_queue.empty() || !p->ctrl_queue.empty();
+		}
+		w_rc_t start_workers(w_int_t n);
+		w_rc_t start_acceptors(w_int_t n, w_addr_t * addr);
+		void add_client(el_socket_t fd, w_addr_t & addr);
+		void send_to_client(peer_t * client, const cmd_request_res_t & cmdr);
+		/* do sockets and the log go through io_uring ? */
+		bool uring_engine() {
+#ifdef WHALE_HAVE_IO_URING
+			return this->ring.get() != nullptr;
+#else
+			return false;
+#endif
+		}
+#ifdef WHALE_HAVE_IO_URING
+		w_rc_t init_uring();
+		void uring_send(peer_t * p);
+		void complete_uring_send(uring_send_t * s, int32_t res);
+		void arm_uring_submit();
+#endif
+		bool leader_reachable() {
+			return this->cur_leader != nullptr &&
+			       event_in_reactor(&this->cur_leader->e);
+		}
 		bool compare_log_to_local(w_int_t last_log_idx, w_int_t last_log_term);
-		inline file_mapped_t * get_fmapped() {
-			return static_cast<file_mapped_t *>(map->get_addr());
+		/* do we have a leader we heard from within the minimum election timeout ? */
+		bool leader_alive() {
+			return this->state == LEADER ||
+			       (this->cur_leader != nullptr &&
+			        this->timers.now() - this->leader_contact < WHALE_MIN_ELEC_TIMEOUT);
 		}
-		std::unique_ptr<file_mmap> 		map;
+		/* current term and vote, stays persistent on disk */
+		std::unique_ptr<meta_store>		meta;
 		std::unique_ptr<logger>			log;
 		std::unique_ptr<config> 		cfg;
 		std::string                     cfg_file;
 		std::map<w_addr_t, peer_t,
-				 WADDR_PRED>            peers, servers, clients;
+				 WADDR_PRED>            peers, servers;
+		std::map<w_addr_t, peer_t,
+				 WADDR_PORT_PRED>       clients;
 		w_int_t							state;
 		w_int_t							commit_index;
 		w_int_t							last_applied;
 		struct reactor                  r;
-		struct event                    elec_timeout_event;
+		/* election, heartbeat, reconnect and client deadline timers */
+		timer_wheel                     timers;
+		/* turns @timers every WHALE_TIMER_TICK ms */
+		struct event                    tick_event;
+		w_timer_t                       elec_timer;
 		/* heartbeat timer */
-		struct event                    hb_timeout_event;
+		w_timer_t                       hb_timer;
+		/* leader-used only: checks every election timeout for a quorum */
+		w_timer_t                       quorum_timer;
 		/* peer-used only */
 		w_int_t                         listen_port;
 		struct event                    listen_event;
@@ -193,6 +468,143 @@ namespace whale {
 		w_addr_t                        self;
 		peer_t                         *cur_leader;
 		w_uint_t                        vote_count;
+		/* pre_vote=on: find out whether we could win before bumping the term */
+		bool                            pre_vote;
+		/*
+		* check_quorum=on: a leader that heard from no majority of
+		* voters for an election timeout steps down.
+		*/
+		bool                            check_quorum;
+		/* when we last heard from a leader, in ms of @timers */
+		uint64_t                        leader_contact;
+		/*
+		* leader-used only: follower leadership is handed over to, new
+		* commands wait in their clients' queues meanwhile.
+		*/
+		peer_t                         *transferee;
+		bool                            timeout_now_sent;
+		bool                            clients_parked;
+		w_timer_t                       transfer_timer;
+		/* SIGUSR1 hands leadership to transfer_to or the most caught up follower */
+		struct event                    transfer_event;
+		std::string                     transfer_to;
+		/* ourselves and the peers line, until the log says otherwise */
+		std::string                     boot_members;
+		/* index of the entry holding the active configuration, 0 for @boot_members */
+		w_int_t                         conf_idx;
+		bool                            self_member;
+		bool                            self_learner;
+		/*
+		* leader-used only: members SIGHUP asked for, reached one server
+		* added or removed at a time. empty once there.
+		*/
+		std::string                     conf_target;
+		struct event                    conf_event;
+		/* runs change_membership() outside of the peer handlers */
+		w_timer_t                       conf_timer;
+		/*
+		* register connections edge-triggered, E_WRITE then stays on
+		* since it only fires when the socket turns writable again.
+		*/
+		bool                            edge_triggered;
+		/* follower-used only: proxy client commands to the leader */
+		bool                            forward_to_leader;
+		/* commands waiting to go out in the next forwarded batch */
+		forward_cmds_t                  forward_batch;
+		struct event                    forward_event;
+		/* forwarded command id -> client that sent it */
+		std::map<w_uint_t, w_addr_t>    forwarding;
+		w_uint_t                        forward_seq;
+		/* leader-used only: commands forwarded by followers, in log order */
+		std::deque<forwarded_cmd_t>     forwarded;
+		w_uint_t                        next_worker;
+		w_uint_t                        conn_seq;
+		/* connection id -> client, for clients served by workers */
+		std::map<w_uint_t, w_addr_t>    worker_conns;
+		/*
+		* connection id -> peer, server or client entry, for as long as
+		* the entry exists. Work that may outlive an entry refers to it
+		* by id and looks it up again.
+		*/
+		std::map<w_uint_t, peer_t *>    conn_peers;
+		/* decoded client requests from every worker */
+		mpsc_queue<worker_event_t>      worker_events;
+		wake_t                          worker_wake;
+		struct event                    worker_event;
+		/*
+		* io_workers=N: client sockets are served by N threads.
+		* declared last so they are stopped before the queues go away.
+		*/
+		std::vector<std::unique_ptr<io_worker>> workers;
+		/* listen backlog of both listening sockets */
+		w_int_t                         backlog;
+		/* options of peer and client connections */
+		sock_opts_t                     peer_opts;
+		sock_opts_t                     client_opts;
+		/* flow control toward each peer */
+		size_t                          peer_max_bytes;
+		w_uint_t                        peer_max_inflight;
+		/* ms between dumps of per-peer gauges, 0 for never */
+		w_int_t                         peer_stats_interval;
+		w_timer_t                       stats_timer;
+		/* ms until a client command is failed, 0 for never */
+		w_int_t                         client_timeout;
+		/* last rpc_id handed out */
+		w_uint_t                        rpc_seq;
+		/* ms a peer request waits for its reply */
+		w_int_t                         rpc_timeout;
+		/* state machine committed entries are applied to */
+		kv_store                        kv;
+		/*
+		* leader-used only: our no-op, membership changes wait until it
+		* commits, reads until it is applied.
+		*/
+		w_int_t                         noop_idx;
+		/*
+		* leader-used only: ReadIndex. every heartbeat starts a read round,
+		* a round is confirmed once a majority answered its heartbeat.
+		* reads wait for the first round started after they came in.
+		*/
+		w_uint_t                        read_round;
+		w_uint_t                        read_confirmed;
+		w_uint_t                        read_wanted;
+		/*
+		* read_lease=on: the leader answers reads on its own until
+		* @lease_from + WHALE_MIN_ELEC_TIMEOUT - @lease_drift, followers
+		* don't vote for anyone else until then. @lease_from is the send
+		* time of the latest request a majority answered.
+		*/
+		bool                            read_lease;
+		w_int_t                         lease_drift;
+		uint64_t                        lease_from;
+		/*
+		* follower_reads=on: followers ask the leader for a read index,
+		* one request for the reads of a reactor iteration, and answer
+		* them once applied that far.
+		*/
+		bool                            follower_reads;
+		w_uint_t                        read_index_seq;
+		/* id the reads coming in now are asked under, 0 if none */
+		w_uint_t                        read_index_open;
+		struct event                    read_index_event;
+		/* leader-used only: read indexes asked by followers, by round */
+		std::deque<remote_read_t>       remote_reads;
+		/* serving_acceptors=N: clients accepted by N threads */
+		mpsc_queue<accepted_conn_t>     accepted;
+		wake_t                          accept_wake;
+		struct event                    accept_event;
+		std::vector<std::unique_ptr<io_acceptor>> acceptors;
+#ifdef WHALE_HAVE_IO_URING
+		/* io_engine=uring: ring for peer sends and log writes */
+		std::unique_ptr<uring>          ring;
+		/* signaled by the ring for completions */
+		el_socket_t                     ring_efd;
+		struct event                    ring_event;
+		/* submits what got queued during this reactor iteration */
+		struct event                    ring_submit_event;
+		/* conn_id of peers whose send found the ring full */
+		std::deque<w_uint_t>            ring_backlog;
+#endif
 	};
 
 }
\ No newline at end of file
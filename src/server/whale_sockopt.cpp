@@ -0,0 +1,125 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <cstring>
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <log.h>
+#include <whale_sockopt.h>
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+namespace whale {
+
+	static w_rc_t get_opt_int(config * cfg, const std::string & key,
+	                          w_int_t * val) {
+		std::string * s = cfg->get(key.c_str());
+
+		if (s == nullptr)
+			return WHALE_GOOD;
+
+		*val = std::stol(*s);
+
+		if (*val < 0) {
+			log_error("%s must not be negative", key.c_str());
+			return WHALE_CONF_ERROR;
+		}
+
+		return WHALE_GOOD;
+	}
+
+	w_rc_t parse_sock_opts(config * cfg, const std::string & prefix,
+	                       sock_opts_t * o) {
+		std::string * s = cfg->get((prefix + "tcp_nodelay").c_str());
+
+		if (s != nullptr)
+			o->nodelay = *s == "on";
+
+		if (get_opt_int(cfg, prefix + "sndbuf", &o->sndbuf) != WHALE_GOOD ||
+		    get_opt_int(cfg, prefix + "rcvbuf", &o->rcvbuf) != WHALE_GOOD ||
+		    get_opt_int(cfg, prefix + "keepalive_idle",
+		                &o->keepalive_idle) != WHALE_GOOD ||
+		    get_opt_int(cfg, prefix + "keepalive_intvl",
+		                &o->keepalive_intvl) != WHALE_GOOD ||
+		    get_opt_int(cfg, prefix + "keepalive_cnt",
+		                &o->keepalive_cnt) != WHALE_GOOD ||
+		    get_opt_int(cfg, prefix + "user_timeout",
+		                &o->user_timeout) != WHALE_GOOD ||
+		    get_opt_int(cfg, prefix + "busy_poll", &o->busy_poll) != WHALE_GOOD)
+			return WHALE_CONF_ERROR;
+
+		return WHALE_GOOD;
+	}
+
+	/*
+	* set one option and check it reads back as @val, or at least @val
+	* for buffer sizes which the kernel doubles for its bookkeeping.
+	*/
+	static bool set_opt(el_socket_t fd, int level, int name, const char * what,
+	                    int val, bool at_least = false) {
+		int       got = 0;
+		socklen_t len = sizeof(got);
+
+		if (::setsockopt(fd, level, name, &val, sizeof(val))) {
+			log_error("failed to set %s=%d on fd[%d]: %s",
+			          what, val, fd, ::strerror(errno));
+			return false;
+		}
+
+		if (::getsockopt(fd, level, name, &got, &len)) {
+			log_error("failed to read back %s on fd[%d]: %s",
+			          what, fd, ::strerror(errno));
+			return false;
+		}
+
+		if (at_least ? got < val : got != val) {
+			log_error("%s on fd[%d] is %d instead of %d", what, fd, got, val);
+			return false;
+		}
+
+		return true;
+	}
+
+	w_rc_t apply_sock_opts(el_socket_t fd, const sock_opts_t & o) {
+		bool ok = true;
+
+		if (o.nodelay)
+			ok &= set_opt(fd, IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY", 1);
+
+		if (o.sndbuf)
+			ok &= set_opt(fd, SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF",
+			              o.sndbuf, true);
+
+		if (o.rcvbuf)
+			ok &= set_opt(fd, SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF",
+			              o.rcvbuf, true);
+
+		if (o.keepalive_idle) {
+			ok &= set_opt(fd, SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE", 1);
+			ok &= set_opt(fd, IPPROTO_TCP, TCP_KEEPIDLE, "TCP_KEEPIDLE",
+			              o.keepalive_idle);
+			if (o.keepalive_intvl)
+				ok &= set_opt(fd, IPPROTO_TCP, TCP_KEEPINTVL, "TCP_KEEPINTVL",
+				              o.keepalive_intvl);
+			if (o.keepalive_cnt)
+				ok &= set_opt(fd, IPPROTO_TCP, TCP_KEEPCNT, "TCP_KEEPCNT",
+				              o.keepalive_cnt);
+		}
+
+		if (o.user_timeout)
+			ok &= set_opt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, "TCP_USER_TIMEOUT",
+			              o.user_timeout);
+
+		if (o.busy_poll)
+			ok &= set_opt(fd, SOL_SOCKET, SO_BUSY_POLL, "SO_BUSY_POLL",
+			              o.busy_poll);
+
+		return ok ? WHALE_GOOD : WHALE_ERROR;
+	}
+}
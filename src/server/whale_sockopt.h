@@ -0,0 +1,53 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef WHALE_SOCKOPT_H_
+#define WHALE_SOCKOPT_H_
+
+#include <string>
+
+#include <cheetah/reactor.h>
+
+#include <define.h>
+#include <whale_config.h>
+
+namespace whale {
+
+	/*
+	* socket options of one role (peer or client connections).
+	* a value of 0 keeps the kernel's default.
+	*/
+	typedef struct sock_opts_s {
+		bool     nodelay;         /* TCP_NODELAY */
+		w_int_t  sndbuf;          /* SO_SNDBUF, bytes */
+		w_int_t  rcvbuf;          /* SO_RCVBUF, bytes */
+		w_int_t  keepalive_idle;  /* TCP_KEEPIDLE, s, turns SO_KEEPALIVE on */
+		w_int_t  keepalive_intvl; /* TCP_KEEPINTVL, s */
+		w_int_t  keepalive_cnt;   /* TCP_KEEPCNT */
+		w_int_t  user_timeout;    /* TCP_USER_TIMEOUT, ms */
+		w_int_t  busy_poll;       /* SO_BUSY_POLL, us */
+	} sock_opts_t;
+
+	#define INIT_SOCK_OPTS {true, 0, 0, 0, 0, 0, 0, 0}
+
+	/*
+	* read @prefix-ed options ("peer_", "client_") from @cfg into @o:
+	* <prefix>tcp_nodelay=on|off, <prefix>sndbuf, <prefix>rcvbuf,
+	* <prefix>keepalive_idle, <prefix>keepalive_intvl, <prefix>keepalive_cnt,
+	* <prefix>user_timeout and <prefix>busy_poll.
+	* Return: WHALE_GOOD on success, WHALE_CONF_ERROR on a negative value.
+	*/
+	w_rc_t parse_sock_opts(config * cfg, const std::string & prefix,
+	                       sock_opts_t * o);
+
+	/*
+	* set @o on @fd and read every option back, logging the ones the
+	* kernel didn't take as asked (buffers clamped by net.core.*mem_max,
+	* SO_BUSY_POLL without CAP_NET_ADMIN, ...). Listening sockets pass
+	* the options on to the connections they accept.
+	* Return: WHALE_GOOD if all of them took effect, WHALE_ERROR otherwise.
+	*/
+	w_rc_t apply_sock_opts(el_socket_t fd, const sock_opts_t & o);
+}
+#endif
@@ -0,0 +1,169 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#ifdef WHALE_HAVE_IO_URING
+
+#include <cstring>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <log.h>
+#include <whale_uring.h>
+
+namespace whale {
+
+	static int io_uring_setup(unsigned entries, struct io_uring_params * p) {
+		return (int)::syscall(__NR_io_uring_setup, entries, p);
+	}
+
+	static int io_uring_enter(int fd, unsigned to_submit,
+	                          unsigned min_complete, unsigned flags) {
+		return (int)::syscall(__NR_io_uring_enter, fd, to_submit,
+		                      min_complete, flags, nullptr, 0);
+	}
+
+	static int io_uring_register(int fd, unsigned opcode,
+	                             const void * arg, unsigned nr_args) {
+		return (int)::syscall(__NR_io_uring_register, fd, opcode,
+		                      arg, nr_args);
+	}
+
+	uring::~uring() {
+		if (this->sqes)
+			::munmap(this->sqes, this->sqes_len);
+		if (this->cq_ptr)
+			::munmap(this->cq_ptr, this->cq_len);
+		if (this->sq_ptr)
+			::munmap(this->sq_ptr, this->sq_len);
+		if (this->fd != -1)
+			::close(this->fd);
+	}
+
+	w_rc_t uring::init(unsigned entries) {
+		struct io_uring_params p;
+		char                  *sq;
+		char                  *cq;
+
+		::memset(&p, 0, sizeof(p));
+
+		if ((this->fd = io_uring_setup(entries, &p)) == -1) {
+			log_error("failed to io_uring_setup: %s", ::strerror(errno));
+			return WHALE_ERROR;
+		}
+
+		this->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		this->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+		this->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+		this->sq_ptr = ::mmap(nullptr, this->sq_len, PROT_READ | PROT_WRITE,
+		                      MAP_SHARED | MAP_POPULATE, this->fd,
+		                      IORING_OFF_SQ_RING);
+		if (this->sq_ptr == MAP_FAILED) {
+			this->sq_ptr = nullptr;
+			goto fail;
+		}
+
+		this->cq_ptr = ::mmap(nullptr, this->cq_len, PROT_READ | PROT_WRITE,
+		                      MAP_SHARED | MAP_POPULATE, this->fd,
+		                      IORING_OFF_CQ_RING);
+		if (this->cq_ptr == MAP_FAILED) {
+			this->cq_ptr = nullptr;
+			goto fail;
+		}
+
+		this->sqes = static_cast<struct io_uring_sqe *>(
+		             ::mmap(nullptr, this->sqes_len, PROT_READ | PROT_WRITE,
+		                    MAP_SHARED | MAP_POPULATE, this->fd,
+		                    IORING_OFF_SQES));
+		if (this->sqes == MAP_FAILED) {
+			this->sqes = nullptr;
+			goto fail;
+		}
+
+		sq = static_cast<char *>(this->sq_ptr);
+		cq = static_cast<char *>(this->cq_ptr);
+
+		this->sq_head = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+		this->sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+		this->sq_mask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+		this->sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+		this->sq_entries = p.sq_entries;
+
+		this->cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+		this->cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+		this->cq_mask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+		this->cqes = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+
+		this->sqe_tail = *this->sq_tail;
+		return WHALE_GOOD;
+
+	fail:
+		log_error("failed to mmap io_uring rings: %s", ::strerror(errno));
+		return WHALE_ERROR;
+	}
+
+	struct io_uring_sqe * uring::get_sqe() {
+		unsigned              head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+		unsigned              idx;
+		struct io_uring_sqe * sqe;
+
+		if (this->sqe_tail - head >= this->sq_entries)
+			return nullptr;
+
+		idx = this->sqe_tail & *this->sq_mask;
+		sqe = &this->sqes[idx];
+		this->sq_array[idx] = idx;
+		++this->sqe_tail;
+		++this->queued;
+
+		::memset(sqe, 0, sizeof(*sqe));
+		return sqe;
+	}
+
+	int uring::submit(unsigned wait_nr) {
+		int ret;
+
+		/* publish the prepared entries before telling the kernel */
+		__atomic_store_n(this->sq_tail, this->sqe_tail, __ATOMIC_RELEASE);
+
+		if (this->queued == 0 && wait_nr == 0)
+			return 0;
+
+		do {
+			ret = io_uring_enter(this->fd, this->queued, wait_nr,
+			                     wait_nr ? IORING_ENTER_GETEVENTS : 0);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret == -1)
+			return -1;
+
+		this->queued -= ret;
+		return ret;
+	}
+
+	struct io_uring_cqe * uring::peek_cqe() {
+		unsigned head = *this->cq_head;
+
+		if (head == __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE))
+			return nullptr;
+
+		return &this->cqes[head & *this->cq_mask];
+	}
+
+	void uring::cqe_seen() {
+		__atomic_store_n(this->cq_head, *this->cq_head + 1, __ATOMIC_RELEASE);
+	}
+
+	int uring::register_buffers(const struct iovec * iov, unsigned n) {
+		return io_uring_register(this->fd, IORING_REGISTER_BUFFERS, iov, n);
+	}
+
+	int uring::register_eventfd(int efd) {
+		return io_uring_register(this->fd, IORING_REGISTER_EVENTFD, &efd, 1);
+	}
+}
+
+#endif
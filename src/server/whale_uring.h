@@ -0,0 +1,99 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef WHALE_URING_H_
+#define WHALE_URING_H_
+
+#ifdef WHALE_HAVE_IO_URING
+
+#include <cstdint>
+
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include <define.h>
+
+namespace whale {
+
+	#define WHALE_URING_ENTRIES    256
+
+	/*
+	* user_data of an operation: its kind in the top byte,
+	* a kind specific value in the rest.
+	*/
+	#define URING_OP_SEND          1
+	#define URING_OP_LOG           2
+	#define URING_DATA(kind, v)    (((uint64_t)(kind) << 56) | (uint64_t)(v))
+	#define URING_KIND(d)          ((d) >> 56)
+	#define URING_VALUE(d)         ((d) & ((1ULL << 56) - 1))
+
+	/*
+	* A minimal io_uring instance driven through the raw system calls.
+	* Operations are prepared with get_sqe() and handed to the kernel in
+	* batches by submit(), completions are reaped with peek_cqe() and
+	* cqe_seen(). Not thread safe.
+	*/
+	class uring {
+	public:
+		uring():fd(-1), sq_ptr(nullptr), cq_ptr(nullptr), sqes(nullptr),
+		        sqe_tail(0), queued(0) {}
+		~uring();
+
+		/*
+		* set up the ring with room for @entries submissions.
+		* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+		*/
+		w_rc_t init(unsigned entries);
+
+		/*
+		* get a zeroed submission entry.
+		* Return: the entry, nullptr if the submission queue is full.
+		*/
+		struct io_uring_sqe * get_sqe();
+
+		/*
+		* hand prepared entries to the kernel, waiting for @wait_nr
+		* completions.
+		* Return: number of entries submitted, -1 on failure.
+		*/
+		int submit(unsigned wait_nr = 0);
+
+		/* Return: the oldest unseen completion, nullptr if there is none. */
+		struct io_uring_cqe * peek_cqe();
+		void cqe_seen();
+
+		int register_buffers(const struct iovec * iov, unsigned n);
+		/* @efd gets signaled for every posted completion */
+		int register_eventfd(int efd);
+
+		/* are there prepared entries not submitted yet ? */
+		bool pending() {return queued != 0;}
+	private:
+		int                  fd;
+		/* submission queue ring */
+		void                *sq_ptr;
+		size_t               sq_len;
+		unsigned            *sq_head;
+		unsigned            *sq_tail;
+		unsigned            *sq_mask;
+		unsigned            *sq_array;
+		unsigned             sq_entries;
+		/* completion queue ring */
+		void                *cq_ptr;
+		size_t               cq_len;
+		unsigned            *cq_head;
+		unsigned            *cq_tail;
+		unsigned            *cq_mask;
+		struct io_uring_cqe *cqes;
+		struct io_uring_sqe *sqes;
+		size_t               sqes_len;
+		/* tail including prepared but unsubmitted entries */
+		unsigned             sqe_tail;
+		unsigned             queued;
+	};
+
+}
+
+#endif
+#endif
@@ -0,0 +1,364 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <cstring>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+
+#include <log.h>
+#include <whale_worker.h>
+
+namespace whale {
+
+	void wake_up(wake_t * w) {
+		uint64_t one = 1;
+
+		if (w->pending.exchange(true, std::memory_order_acq_rel))
+			return;
+
+		TEMP_FAILURE_RETRY(::write(w->efd, &one, sizeof(one)));
+	}
+
+	void wake_consume(wake_t * w) {
+		uint64_t cnt;
+
+		TEMP_FAILURE_RETRY(::read(w->efd, &cnt, sizeof(cnt)));
+		w->pending.store(false, std::memory_order_release);
+	}
+
+	static void
+	worker_wakeup_callback(el_socket_t fd, short res_flags, void *arg) {
+		io_worker * w = static_cast<io_worker *>(arg);
+		w->handle_wakeup();
+	}
+
+	static void
+	worker_conn_callback(el_socket_t fd, short res_flags, void *arg) {
+		worker_conn_t * c = static_cast<worker_conn_t *>(arg);
+
+		if (res_flags & E_READ)
+			c->worker->handle_read(c);
+
+		/* the read might have closed it */
+		if ((res_flags & E_WRITE) && event_in_reactor(&c->e))
+			c->worker->handle_write(c);
+	}
+
+	io_worker::~io_worker() {
+		stop();
+	}
+
+	w_rc_t io_worker::start() {
+		if ((this->wake.efd = ::eventfd(0, EFD_NONBLOCK)) == -1) {
+			log_error("failed to create eventfd: %s", ::strerror(errno));
+			return WHALE_ERROR;
+		}
+		this->wake.pending.store(false);
+
+		reactor_init_with_signal_timer(&this->r, NULL);
+
+		::memset(&this->wake_event, 0, sizeof(struct event));
+		event_set(&this->wake_event, this->wake.efd, E_READ,
+		          worker_wakeup_callback, this);
+
+		if (reactor_add_event(&this->r, &this->wake_event) == -1) {
+			log_error("failed to reactor_add_event for worker wakeup: %s",
+			          ::strerror(errno));
+			reactor_destroy(&this->r);
+			TEMP_FAILURE_RETRY(::close(this->wake.efd));
+			return WHALE_ERROR;
+		}
+
+		this->started = true;
+		this->thread = std::thread([this]() {
+			struct timeval timeout = {0, 100000};
+
+			reactor_loop(&this->r, &timeout, 0);
+		});
+
+		return WHALE_GOOD;
+	}
+
+	void io_worker::stop() {
+		if (!this->started)
+			return;
+
+		this->stopping.store(true);
+		/* bypass the pending flag, the stop must get through */
+		uint64_t one = 1;
+		TEMP_FAILURE_RETRY(::write(this->wake.efd, &one, sizeof(one)));
+
+		this->thread.join();
+		this->started = false;
+
+		reactor_destroy(&this->r);
+		TEMP_FAILURE_RETRY(::close(this->wake.efd));
+	}
+
+	void io_worker::post(worker_cmd_t && c) {
+		this->cmds.push(std::move(c));
+		wake_up(&this->wake);
+	}
+
+	void io_worker::notify_core(worker_event_t && ev) {
+		this->events->push(std::move(ev));
+		wake_up(this->core_wake);
+	}
+
+	void io_worker::handle_wakeup() {
+		worker_cmd_t c;
+
+		wake_consume(&this->wake);
+
+		if (this->stopping.load()) {
+			while (!this->conns.empty())
+				close_conn(this->conns.begin()->second.get(), false);
+
+			reactor_remove_event(&this->r, &this->wake_event);
+			reactor_get_out(&this->r);
+			return;
+		}
+
+		while (this->cmds.pop(c)) {
+			auto it = this->conns.find(c.conn_id);
+
+			switch (c.type) {
+			case WORKER_CMD_ADD:
+				add_conn(c.conn_id, c.fd);
+				break;
+			case WORKER_CMD_REPLY:
+				if (it != this->conns.end())
+					it->second->out.push_back(
+					    msg_sptr{make_msg_from_cmd_request_res(c.res)});
+				break;
+			case WORKER_CMD_CLOSE:
+				if (it != this->conns.end())
+					close_conn(it->second.get(), false);
+				break;
+			}
+		}
+
+		/* flush the whole batch of replies with one write per client */
+		for (auto & it : this->conns) {
+			if (!it.second->out.empty())
+				handle_write(it.second.get());
+		}
+	}
+
+	void io_worker::add_conn(w_uint_t conn_id, el_socket_t fd) {
+		worker_conn_t * c = new worker_conn_t;
+
+		c->conn_id = conn_id;
+		c->worker = this;
+		c->want_write = false;
+		c->rbuf.reset(new char[WHALE_WORKER_RBUF + 1]);
+		c->rbuf_start = c->rbuf_end = 0;
+		c->out_pin = 0;
+
+		this->conns[conn_id] = std::unique_ptr<worker_conn_t>(c);
+
+		::memset(&c->e, 0, sizeof(struct event));
+		event_set(&c->e, fd, E_READ, worker_conn_callback, c);
+
+		if (reactor_add_event(&this->r, &c->e) == -1) {
+			log_error("failed to reactor_add_event for client fd[%d]: %s",
+			          fd, ::strerror(errno));
+			TEMP_FAILURE_RETRY(::close(fd));
+			this->conns.erase(conn_id);
+			notify_core({WORKER_EV_CLOSED, conn_id, nullptr});
+		}
+	}
+
+	/*
+	* @notify: tell the core, which doesn't know yet.
+	*/
+	void io_worker::close_conn(worker_conn_t * c, bool notify) {
+		w_uint_t conn_id = c->conn_id;
+
+		if (event_in_reactor(&c->e))
+			reactor_remove_event(&this->r, &c->e);
+		TEMP_FAILURE_RETRY(::close(c->e.fd));
+
+		this->conns.erase(conn_id);
+
+		if (notify)
+			notify_core({WORKER_EV_CLOSED, conn_id, nullptr});
+	}
+
+	/*
+	* decode every complete frame in @c's buffer and pass the commands on.
+	* Return: false if the connection got closed.
+	*/
+	bool io_worker::process_frames(worker_conn_t * c) {
+		char   * buf = c->rbuf.get();
+		uint32_t len;
+		char     saved;
+
+		while (c->rbuf_end - c->rbuf_start >= sizeof(uint32_t)) {
+			char * frame = buf + c->rbuf_start;
+
+			::memcpy(&len, frame, sizeof(uint32_t));
+			len = ::ntohl(len);
+
+			if (len < sizeof(message_t) || len > WHALE_WORKER_RBUF) {
+				log_error("invalid message length %u from client fd[%d]",
+				          len, c->e.fd);
+				close_conn(c, true);
+				return false;
+			}
+
+			if (c->rbuf_end - c->rbuf_start < len)
+				break;
+
+			c->rbuf_start += len;
+
+			/* nul-terminate the payload in place for the parser */
+			saved = frame[len];
+			frame[len] = '\0';
+
+			message_t * m = reinterpret_cast<message_t *>(frame);
+
+			if (::ntohl(m->msg_type) == MESSAGE_CMD_REQUEST ||
+			    ::ntohl(m->msg_type) == MESSAGE_READ_REQUEST) {
+				cmd_sptr cmd{make_cmd_request_from_msg(*m)};
+
+				if (cmd.get() == nullptr) {
+					log_error("malformed command from client fd[%d]", c->e.fd);
+				} else {
+					notify_core({WORKER_EV_CMD, c->conn_id, cmd});
+				}
+			}
+
+			frame[len] = saved;
+		}
+
+		if (c->rbuf_start == c->rbuf_end) {
+			c->rbuf_start = c->rbuf_end = 0;
+		} else if (c->rbuf_end == WHALE_WORKER_RBUF) {
+			uint32_t avail = c->rbuf_end - c->rbuf_start;
+
+			::memmove(buf, buf + c->rbuf_start, avail);
+			c->rbuf_start = 0;
+			c->rbuf_end = avail;
+		}
+
+		return true;
+	}
+
+	void io_worker::handle_read(worker_conn_t * c) {
+		ssize_t  nread;
+		uint32_t room;
+
+		for (;;) {
+			room = WHALE_WORKER_RBUF - c->rbuf_end;
+			nread = ::read(c->e.fd, c->rbuf.get() + c->rbuf_end, room);
+
+			if (nread <= 0) {
+				if (nread == 0) { /* client closed connection */
+					close_conn(c, true);
+					return;
+				} else if (errno == EINTR) { /* retry */
+					continue;
+				} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					return;
+				}
+
+				log_error("error occured during ::read() from fd[%d]: %s",
+				          c->e.fd, ::strerror(errno));
+				close_conn(c, true);
+				return;
+			}
+
+			c->rbuf_end += nread;
+
+			if (!process_frames(c))
+				return;
+
+			/* drained, the reactor tells us about more */
+			if ((uint32_t)nread < room)
+				return;
+		}
+	}
+
+	void io_worker::handle_write(worker_conn_t * c) {
+		struct iovec  iov[WHALE_WORKER_IOV];
+		struct msghdr mh;
+		size_t        cnt;
+		ssize_t       nwrite;
+
+		while (!c->out.empty()) {
+			cnt = 0;
+
+			for (auto & m : c->out) {
+				if (cnt == WHALE_WORKER_IOV)
+					break;
+
+				iov[cnt].iov_base = (char *)m.get() + (cnt ? 0 : c->out_pin);
+				iov[cnt].iov_len = MESSAGE_SIZE(m) - (cnt ? 0 : c->out_pin);
+				++cnt;
+			}
+
+			::memset(&mh, 0, sizeof(mh));
+			mh.msg_iov = iov;
+			mh.msg_iovlen = cnt;
+
+			/* a closed client shows up as EPIPE rather than SIGPIPE */
+			nwrite = ::sendmsg(c->e.fd, &mh, MSG_NOSIGNAL);
+
+			if (nwrite == -1) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					break;
+				} else if (errno == EINTR) { /* retry */
+					continue;
+				}
+
+				/* client went away */
+				close_conn(c, true);
+				return;
+			}
+
+			/* retire fully written frames, advance into the partial one */
+			while (nwrite > 0) {
+				size_t left = MESSAGE_SIZE(c->out.front()) - c->out_pin;
+
+				if ((size_t)nwrite < left) {
+					c->out_pin += nwrite;
+					break;
+				}
+
+				nwrite -= left;
+				c->out_pin = 0;
+				c->out.pop_front();
+			}
+		}
+
+		update_write_interest(c);
+	}
+
+	/*
+	* ask for E_WRITE only while replies are pending.
+	*/
+	void io_worker::update_write_interest(worker_conn_t * c) {
+		bool want = !c->out.empty();
+
+		if (want == c->want_write)
+			return;
+
+		c->want_write = want;
+
+		reactor_remove_event(&this->r, &c->e);
+		event_set(&c->e, c->e.fd, E_READ | (want ? E_WRITE : 0),
+		          worker_conn_callback, c);
+
+		if (reactor_add_event(&this->r, &c->e) == -1) {
+			log_error("failed to reactor_add_event for client fd[%d]: %s",
+			          c->e.fd, ::strerror(errno));
+			close_conn(c, true);
+		}
+	}
+}
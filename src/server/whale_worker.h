@@ -0,0 +1,143 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+
+#ifndef WHALE_WORKER_H_
+#define WHALE_WORKER_H_
+
+#include <map>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+
+#include <cheetah/reactor.h>
+
+#include <define.h>
+#include <message.h>
+#include <lf_queue.h>
+
+namespace whale {
+
+	/* client frames larger than this close the connection */
+	#define WHALE_WORKER_RBUF       (64 * 1024)
+	#define WHALE_WORKER_IOV        64
+
+	/* what the consensus core asks a worker to do */
+	#define WORKER_CMD_ADD          0   /* take over client socket @fd */
+	#define WORKER_CMD_REPLY        1   /* send @res to the client */
+	#define WORKER_CMD_CLOSE        2   /* drop the connection */
+
+	typedef struct worker_cmd_s {
+		w_int_t           type;
+		w_uint_t          conn_id;
+		el_socket_t       fd;
+		cmd_request_res_t res;
+	} worker_cmd_t;
+
+	/* what a worker tells the consensus core */
+	#define WORKER_EV_CMD           0   /* client sent @cmd */
+	#define WORKER_EV_CLOSED        1   /* client connection is gone */
+
+	typedef struct worker_event_s {
+		w_int_t           type;
+		w_uint_t          conn_id;
+		cmd_sptr          cmd;
+	} worker_event_t;
+
+	/*
+	* wakeup side of a lock-free queue: the producer signals @efd only if
+	* the consumer didn't get signaled since it last drained the queue.
+	*/
+	typedef struct wake_s {
+		el_socket_t       efd;
+		std::atomic<bool> pending;
+	} wake_t;
+
+	class io_worker;
+
+	/* a client connection owned by a worker */
+	typedef struct worker_conn_s {
+		w_uint_t                conn_id;
+		struct event            e;
+		io_worker              *worker;
+		/* is E_WRITE currently registered for @e ? */
+		bool                    want_write;
+		/* bytes in [@rbuf_start, @rbuf_end) are unhandled */
+		std::unique_ptr<char[]> rbuf;
+		uint32_t                rbuf_start;
+		uint32_t                rbuf_end;
+		/* frames waiting to be written, @out_pin bytes of the first are sent */
+		std::deque<msg_sptr>    out;
+		uint32_t                out_pin;
+	} worker_conn_t;
+
+	/*
+	* An I/O thread owning a share of the client connections.
+	*
+	* It reads and frames client requests, decodes them and hands them to
+	* the consensus core through @events. Replies come back from the core
+	* as plain results through @cmds, are encoded here and written out.
+	* All Raft state stays on the core thread.
+	*
+	* Peer connections are not served here. Their I/O path is Raft state:
+	* replies pair with requests through peer_t::rpcs and its timers, the
+	* flow control counters and ctrl_queue merging decide what a write
+	* carries, and closing a connection rewinds next_idx. AppendEntries
+	* are encoded straight from the log the core keeps appending to and
+	* chopping, and io_uring peer sends share the core's ring with the
+	* log writes. Moving them would take copies of entries and a ring
+	* per worker, for the few connections a cluster has.
+	*/
+	class io_worker {
+	public:
+		io_worker(mpsc_queue<worker_event_t> * events, wake_t * core_wake)
+			:events(events), core_wake(core_wake), stopping(false),
+			 started(false) {}
+		~io_worker();
+
+		/*
+		* start the worker thread.
+		* Return: WHALE_GOOD on success, WHALE_ERROR on failure.
+		*/
+		w_rc_t start();
+		void stop();
+
+		/* core thread only */
+		void post(worker_cmd_t && c);
+
+		void handle_wakeup();
+		void handle_read(worker_conn_t * c);
+		void handle_write(worker_conn_t * c);
+	private:
+		void add_conn(w_uint_t conn_id, el_socket_t fd);
+		void close_conn(worker_conn_t * c, bool notify);
+		bool process_frames(worker_conn_t * c);
+		void update_write_interest(worker_conn_t * c);
+		void notify_core(worker_event_t && ev);
+
+		struct reactor                  r;
+		std::map<w_uint_t, std::unique_ptr<worker_conn_t>> conns;
+		/* core -> worker */
+		spsc_queue<worker_cmd_t>        cmds;
+		wake_t                          wake;
+		struct event                    wake_event;
+		/* worker -> core, shared by every worker */
+		mpsc_queue<worker_event_t>     *events;
+		wake_t                         *core_wake;
+		std::atomic<bool>               stopping;
+		bool                            started;
+		std::thread                     thread;
+	};
+
+	/*
+	* signal @w's eventfd unless a wakeup is pending already.
+	*/
+	void wake_up(wake_t * w);
+
+	/*
+	* consumer side: clear @w's pending wakeup before draining the queue.
+	*/
+	void wake_consume(wake_t * w);
+}
+#endif
@@ -0,0 +1,154 @@
+/*
+* Copyright (C) Xinjing Cho
+*/
+#include <cstdio>
+#include <cstring>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <whale_sockopt.h>
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+/*
+* apply_sock_opts() on a listening socket, on a connected socket and
+* through a listening socket onto the connection it accepts, every
+* option read back with getsockopt().
+*/
+
+using namespace whale;
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {                               \
+		if (!(cond)) {                                      \
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                   \
+			fprintf(stderr, "\n");                          \
+			++failures;                                     \
+		}                                                   \
+	} while (0)
+
+static int get_int(int fd, int level, int name) {
+	int       val = -1;
+	socklen_t len = sizeof(val);
+
+	if (::getsockopt(fd, level, name, &val, &len))
+		return -1;
+
+	return val;
+}
+
+/*
+* assert every option of @o on @fd. buffer sizes read back doubled, the
+* kernel keeps room for its bookkeeping.
+*/
+static void check_opts(const char * what, int fd, const sock_opts_t & o) {
+	CHECK(get_int(fd, IPPROTO_TCP, TCP_NODELAY) == (o.nodelay ? 1 : 0),
+	      "%s: TCP_NODELAY", what);
+	CHECK(get_int(fd, SOL_SOCKET, SO_SNDBUF) >= o.sndbuf,
+	      "%s: SO_SNDBUF %d < %ld", what,
+	      get_int(fd, SOL_SOCKET, SO_SNDBUF), (long)o.sndbuf);
+	CHECK(get_int(fd, SOL_SOCKET, SO_RCVBUF) >= o.rcvbuf,
+	      "%s: SO_RCVBUF %d < %ld", what,
+	      get_int(fd, SOL_SOCKET, SO_RCVBUF), (long)o.rcvbuf);
+	CHECK(get_int(fd, SOL_SOCKET, SO_KEEPALIVE) == 1,
+	      "%s: SO_KEEPALIVE", what);
+	CHECK(get_int(fd, IPPROTO_TCP, TCP_KEEPIDLE) == o.keepalive_idle,
+	      "%s: TCP_KEEPIDLE", what);
+	CHECK(get_int(fd, IPPROTO_TCP, TCP_KEEPINTVL) == o.keepalive_intvl,
+	      "%s: TCP_KEEPINTVL", what);
+	CHECK(get_int(fd, IPPROTO_TCP, TCP_KEEPCNT) == o.keepalive_cnt,
+	      "%s: TCP_KEEPCNT", what);
+	CHECK(get_int(fd, IPPROTO_TCP, TCP_USER_TIMEOUT) == o.user_timeout,
+	      "%s: TCP_USER_TIMEOUT", what);
+}
+
+static int make_listener(struct sockaddr_in * addr) {
+	socklen_t len = sizeof(*addr);
+	int       fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+	::memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+
+	if (fd == -1 ||
+	    ::bind(fd, (struct sockaddr *)addr, sizeof(*addr)) ||
+	    ::getsockname(fd, (struct sockaddr *)addr, &len)) {
+		perror("listener");
+		return -1;
+	}
+
+	return fd;
+}
+
+int main() {
+	sock_opts_t        o = INIT_SOCK_OPTS;
+	sock_opts_t        off = INIT_SOCK_OPTS;
+	struct sockaddr_in addr;
+	int                lfd, cfd, afd, fd;
+
+	o.nodelay = true;
+	o.sndbuf = 128 * 1024;
+	o.rcvbuf = 256 * 1024;
+	o.keepalive_idle = 30;
+	o.keepalive_intvl = 5;
+	o.keepalive_cnt = 4;
+	o.user_timeout = 7000;
+
+	/* options set before listen() carry over to accepted connections */
+	if ((lfd = make_listener(&addr)) == -1)
+		return 1;
+
+	CHECK(apply_sock_opts(lfd, o) == WHALE_GOOD, "apply on listener");
+	CHECK(::listen(lfd, 1) == 0, "listen: %s", ::strerror(errno));
+	check_opts("listener", lfd, o);
+
+	cfd = ::socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(::connect(cfd, (struct sockaddr *)&addr, sizeof(addr)) == 0,
+	      "connect: %s", ::strerror(errno));
+	afd = ::accept(lfd, nullptr, nullptr);
+	CHECK(afd != -1, "accept: %s", ::strerror(errno));
+	check_opts("accepted", afd, o);
+
+	/* and a connected socket takes them directly */
+	CHECK(apply_sock_opts(cfd, o) == WHALE_GOOD, "apply on connected");
+	check_opts("connected", cfd, o);
+
+	/* tcp_nodelay=off leaves Nagle on, nothing else gets touched */
+	off.nodelay = false;
+	fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(apply_sock_opts(fd, off) == WHALE_GOOD, "apply defaults");
+	CHECK(get_int(fd, IPPROTO_TCP, TCP_NODELAY) == 0, "defaults: TCP_NODELAY");
+	CHECK(get_int(fd, SOL_SOCKET, SO_KEEPALIVE) == 0, "defaults: SO_KEEPALIVE");
+	::close(fd);
+
+	/* SO_BUSY_POLL needs CAP_NET_ADMIN, without it the failure is reported */
+	off.busy_poll = 50;
+	fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (apply_sock_opts(fd, off) == WHALE_GOOD)
+		CHECK(get_int(fd, SOL_SOCKET, SO_BUSY_POLL) == 50, "SO_BUSY_POLL");
+	else
+		CHECK(get_int(fd, SOL_SOCKET, SO_BUSY_POLL) != 50,
+		      "SO_BUSY_POLL set but reported as failed");
+	::close(fd);
+
+	::close(afd);
+	::close(cfd);
+	::close(lfd);
+
+	if (failures) {
+		fprintf(stderr, "sockopt_test: %d failed\n", failures);
+		return 1;
+	}
+
+	printf("sockopt_test: ok\n");
+	return 0;
+}